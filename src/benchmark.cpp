@@ -19,6 +19,7 @@
 #include <fstream>
 #include <iostream>
 #include <istream>
+#include <sstream>
 #include <vector>
 
 #include "position.h"
@@ -91,6 +92,19 @@ const vector<string> Defaults = {
   "setoption name UCI_Chess960 value false"
 };
 
+// A game between two Stockfish instances, 120 plies from the start position,
+// whose positions are searched one after the other by speedtest
+const vector<string> SpeedtestGame = {
+  "e2e4 e7e5 g1f3 g8f6 f3e5 d7d6 e5f3 f6e4 d2d4 f8e7 f1d3 d6d5 e1g1 e4d6 c1f4 c8e6",
+  "c2c3 b8d7 b1d2 e8g8 f1e1 g7g6 d2f1 a7a5 h2h3 f8e8 f1g3 c7c5 a2a4 c5c4 d3c2 a8a6",
+  "a1b1 a6b6 d1d2 d7f8 g3f1 f8d7 f1g3 d7f8 g3f1 f8d7 e1e2 d7f6 d2c1 f6e4 f1g3 e4g3",
+  "f4g3 e7f8 c1d2 d8d7 g3f4 d7d8 f3h2 d8d7 h2f3 d7d8 e2e1 f7f6 f3h2 e6d7 e1e8 d8e8",
+  "b1e1 e8c8 d2c1 d6f7 h2f1 d7e6 h3h4 c8d7 f1e3 g8g7 f2f3 h7h6 c1b1 f6f5 h4h5 g6h5",
+  "e1e2 f8d6 e3f5 e6f5 c2f5 d7d8 f4d6 b6d6 b1e1 d8g5 f5e6 g5f6 f3f4 g7f8 f4f5 h5h4",
+  "e1f2 f7d8 e6c8 f6g5 f2f3 g5c1 g1h2 c1g5 h2h3 f8g7 c8e6 g7f6 e2e5 d8f7 e6f7 f6f7",
+  "e5d5 d6b6 d5b5 b6b5 a4b5 f7f8 f3g4 g5c1"
+};
+
 } // namespace
 
 namespace Stockfish {
@@ -99,14 +113,16 @@ namespace Stockfish {
 /// are five parameters: TT size in MB, number of search threads that
 /// should be used, the limit value spent for each position, a file name
 /// where to look for positions in FEN format, the type of the limit:
-/// depth, perft, nodes and movetime (in millisecs), and evaluation type
-/// mixed (default), classical, NNUE.
+/// depth, perft, nodes and movetime (in millisecs), evaluation type
+/// mixed (default), classical, NNUE, and "perf" to set the PerfCounters
+/// option.
 ///
 /// bench -> search default positions up to depth 13
 /// bench 64 1 15 -> search default positions up to depth 15 (TT = 64MB)
 /// bench 64 4 5000 current movetime -> search current position with 4 threads for 5 sec
 /// bench 64 1 100000 default nodes -> search default positions for 100K nodes each
 /// bench 16 1 5 default perft -> run a perft 5 on default positions
+/// bench 16 1 13 default depth mixed perf -> also count hardware events
 
 vector<string> setup_bench(const Position& current, istream& is) {
 
@@ -120,6 +136,7 @@ vector<string> setup_bench(const Position& current, istream& is) {
   string fenFile   = (is >> token) ? token : "default";
   string limitType = (is >> token) ? token : "depth";
   string evalType  = (is >> token) ? token : "mixed";
+  string perf      = (is >> token) ? token : "";
 
   go = limitType == "eval" ? "eval" : "go " + limitType + " " + limit;
 
@@ -149,6 +166,10 @@ vector<string> setup_bench(const Position& current, istream& is) {
 
   list.emplace_back("setoption name Threads value " + threads);
   list.emplace_back("setoption name Hash value " + ttSize);
+
+  if (perf == "perf")
+      list.emplace_back("setoption name PerfCounters value true");
+
   list.emplace_back("ucinewgame");
 
   size_t posCounter = 0;
@@ -172,4 +193,30 @@ vector<string> setup_bench(const Position& current, istream& is) {
   return list;
 }
 
+/// setup_speedtest() builds the list of "position" commands of speedtest, one
+/// per ply of SpeedtestGame, each adding a move to the previous one as a GUI
+/// does during a game.
+
+vector<string> setup_speedtest() {
+
+  vector<string> list;
+  string moves;
+
+  list.emplace_back("position startpos");
+
+  for (const string& line : SpeedtestGame)
+  {
+      istringstream is(line);
+      string move;
+
+      while (is >> move)
+      {
+          moves += " " + move;
+          list.emplace_back("position startpos moves" + moves);
+      }
+  }
+
+  return list;
+}
+
 } // namespace Stockfish
@@ -36,6 +36,10 @@ Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 Magic RookMagics[SQUARE_NB];
 Magic BishopMagics[SQUARE_NB];
 
+#if defined(USE_DISPATCH) && !defined(USE_PEXT)
+const bool HasPext = cpu_info().bmi2 && !cpu_info().slowPext;
+#endif
+
 namespace {
 
   Bitboard RookTable[0x19000];  // To store rook attacks
@@ -94,9 +94,15 @@ namespace Eval {
         {
             if (directory != "<internal>")
             {
-                ifstream stream(directory + eval_file, ios::binary);
-                if (load_eval(eval_file, stream))
+                // A network image is used in place, otherwise parse a .nnue file
+                if (load_image(eval_file, directory + eval_file))
                     currentEvalFileName = eval_file;
+                else
+                {
+                    ifstream stream(directory + eval_file, ios::binary);
+                    if (load_eval(eval_file, stream))
+                        currentEvalFileName = eval_file;
+                }
             }
 
             if (directory == "<internal>" && eval_file == EvalFileDefaultName)
@@ -21,6 +21,7 @@
 
 #include <string>
 #include <optional>
+#include <vector>
 
 #include "types.h"
 
@@ -43,16 +44,60 @@ namespace Eval {
 
   namespace NNUE {
 
+    // Totals of NNUE::benchmark() over a set of positions
+    struct BenchmarkStats {
+      uint64_t evaluations, nanoseconds, blocks, nonZeroBlocks;
+      int64_t checksum;
+    };
+
+    // Time spent in one kernel of the network by NNUE::benchmark_layers()
+    struct LayerStats {
+      std::string name;
+      uint64_t calls, nanoseconds, cycles, bytes;
+    };
+
+    // Timings of the kernels compiled for one instruction set
+    struct LayerBenchmark {
+      std::string arch;
+      std::vector<LayerStats> layers;
+    };
+
     std::string trace(Position& pos);
+    void benchmark(const Position& pos, int iterations, BenchmarkStats& stats);
+    std::vector<LayerBenchmark> benchmark_layers(const std::vector<std::string>& fens, int iterations);
     Value evaluate(const Position& pos, bool adjusted = false, int* complexity = nullptr);
+    void evaluate(const Position* const* positions, std::size_t count, Value* values);
 
     void init();
     void verify();
 
     bool load_eval(std::string name, std::istream& stream);
+    bool load_image(std::string name, const std::string& path);
+    bool save_image(const std::string& filename);
     bool save_eval(std::ostream& stream);
     bool save_eval(const std::optional<std::string>& filename);
 
+#if defined(USE_DISPATCH)
+    // Arch holds the functions above for one instruction set. The NNUE code is
+    // compiled once per instruction set and the one in use is picked at startup.
+    struct Arch {
+      const char* name;
+      std::string (*trace)(Position&);
+      void (*benchmark)(const Position&, int, BenchmarkStats&);
+      void (*benchmark_layers)(const std::vector<std::string>&, int, std::vector<LayerStats>&);
+      Value (*evaluate)(const Position&, bool, int*);
+      void (*evaluate_batch)(const Position* const*, std::size_t, Value*);
+      bool (*load_eval)(std::string, std::istream&);
+      bool (*load_image)(std::string, const std::string&);
+      bool (*save_image)(const std::string&);
+      bool (*save_eval)(std::ostream&);
+      bool (*save_eval_file)(const std::optional<std::string>&);
+      void (*release)();
+    };
+
+    const char* arch_name();
+#endif
+
   } // namespace NNUE
 
 } // namespace Eval
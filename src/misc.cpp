@@ -41,16 +41,23 @@ typedef WORD(*fun5_t)();
 }
 #endif
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <linux/perf_event.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) || (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && !defined(_WIN32)) || defined(__e2k__)
@@ -58,6 +65,14 @@ typedef WORD(*fun5_t)();
 #include <stdlib.h>
 #endif
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <x86intrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#include "evaluate.h"
 #include "misc.h"
 #include "thread.h"
 
@@ -243,7 +258,9 @@ std::string compiler_info() {
   #if defined(USE_AVX512)
     compiler += " AVX512";
   #endif
-  compiler += (HasPext ? " BMI2" : "");
+  #if defined(USE_PEXT)
+    compiler += " BMI2";
+  #endif
   #if defined(USE_AVX2)
     compiler += " AVX2";
   #endif
@@ -264,10 +281,30 @@ std::string compiler_info() {
     compiler += " NEON";
   #endif
 
+  #if defined(TT_LOCKLESS)
+    compiler += " LOCKLESS_TT";
+  #endif
+  #if defined(TT_STATS)
+    compiler += " TT_STATS";
+  #endif
+  #if defined(TT_CLUSTER_BYTES) && TT_CLUSTER_BYTES != 32
+    compiler += " TT_CLUSTER" + std::to_string(TT_CLUSTER_BYTES);
+  #endif
+
+  #if defined(USE_DISPATCH)
+    compiler += " DISPATCH";
+  #endif
+
   #if !defined(NDEBUG)
     compiler += " DEBUG";
   #endif
 
+  #if defined(USE_DISPATCH)
+    compiler += "\nRuntime dispatch picked: NNUE ";
+    compiler += Eval::NNUE::arch_name();
+    compiler += (HasPext ? ", pext attacks" : ", magic attacks");
+  #endif
+
   compiler += "\n__VERSION__ macro expands to: ";
   #ifdef __VERSION__
      compiler += __VERSION__;
@@ -489,6 +526,168 @@ void aligned_large_pages_free(void *mem) {
 #endif
 
 
+/// cpu_info() reads the instruction sets of the CPU once, all false when not on
+/// x86 or when not compiled with GCC or a compatible compiler. AVX2 and AVX-512
+/// also need the OS to save their registers, which xgetbv tells.
+
+const CpuInfo& cpu_info() {
+
+  static const CpuInfo info = [] {
+      CpuInfo ci{};
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+      unsigned maxLeaf = 0, vendor[3] = {}, xcr0 = 0;
+
+      __get_cpuid(0, &maxLeaf, &vendor[0], &vendor[2], &vendor[1]);
+      __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+      unsigned family = (eax >> 8) & 0xF;
+      if (family == 0xF)
+          family += (eax >> 20) & 0xFF;
+
+      ci.sse41  = ecx & (1 << 19);
+      ci.popcnt = ecx & (1 << 23);
+
+      if (ecx & (1 << 27)) // OSXSAVE
+          __asm__("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+
+      bool ymm = (xcr0 & 0x06) == 0x06;
+      bool zmm = ymm && (xcr0 & 0xE0) == 0xE0;
+
+      if (maxLeaf >= 7)
+      {
+          __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+
+          ci.avx2    = ymm && (ebx & (1 << 5));
+          ci.bmi2    = ebx & (1 << 8);
+          ci.avx512  = zmm && (ebx & (1 << 16)) && (ebx & (1 << 30)); // F and BW
+          ci.vnni512 = ci.avx512 && (ebx & (1 << 17)) && (ebx & (1u << 31)) // DQ and VL
+                                 && (ecx & (1 << 11));
+      }
+
+      ci.slowPext = ci.bmi2 && !memcmp(vendor, "AuthenticAMD", 12) && family < 0x19;
+#endif
+
+      return ci;
+  }();
+
+  return info;
+}
+
+
+/// cpu_cycles() is used to time short stretches of code, see misc.h
+
+uint64_t cpu_cycles() {
+
+#if (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) \
+ || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+/// PerfCounters::open() opens the counters of the calling thread, disabled and
+/// counting in user space only, which perf_event_paranoid up to 2 allows.
+
+void PerfCounters::open() {
+
+  close();
+  opened = true;
+
+#if defined(__linux__) && !defined(__ANDROID__) && defined(SYS_perf_event_open)
+
+  constexpr uint64_t DTLBReadMiss =  PERF_COUNT_HW_CACHE_DTLB
+                                  | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+  constexpr std::pair<uint32_t, uint64_t> Events[EVENT_NB] = {
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }, // Last level cache
+      { PERF_TYPE_HW_CACHE, DTLBReadMiss },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+  };
+
+  for (int e = 0; e < EVENT_NB; ++e)
+  {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = Events[e].first;
+      attr.config = Events[e].second;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      fd[e] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+
+#endif
+}
+
+void PerfCounters::close() {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  for (int& f : fd)
+      if (f >= 0)
+          ::close(f);
+#endif
+
+  std::fill(std::begin(fd), std::end(fd), -1);
+  opened = false;
+}
+
+void PerfCounters::start() {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  for (int f : fd)
+      if (f >= 0)
+      {
+          ioctl(f, PERF_EVENT_IOC_RESET, 0);
+          ioctl(f, PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+}
+
+void PerfCounters::stop() {
+
+  for (int e = 0; e < EVENT_NB; ++e)
+  {
+      last[e] = 0;
+
+#if defined(__linux__) && !defined(__ANDROID__)
+      uint64_t v[3]; // Value, time enabled, time running
+
+      if (   fd[e] >= 0
+          && !ioctl(fd[e], PERF_EVENT_IOC_DISABLE, 0)
+          && ::read(fd[e], v, sizeof(v)) == sizeof(v)
+          && v[2])
+          last[e] = v[2] < v[1] ? uint64_t(double(v[0]) * v[1] / v[2]) : v[0];
+#endif
+
+      total[e] += last[e];
+  }
+}
+
+void PerfCounters::clear() {
+
+  std::fill(std::begin(last), std::end(last), 0);
+  std::fill(std::begin(total), std::end(total), 0);
+}
+
+const char* PerfCounters::name(Event e) {
+
+  constexpr const char* Names[EVENT_NB] = {
+      "cycles", "instructions", "LLC misses", "dTLB misses", "branch misses"
+  };
+  return Names[e];
+}
+
+
 namespace WinProcGroup {
 
 #ifndef _WIN32
@@ -612,6 +811,150 @@ void bindThisThread(size_t idx) {
 
 } // namespace WinProcGroup
 
+
+namespace Numa {
+
+#if defined(__linux__) && !defined(__ANDROID__) && defined(SYS_mbind) && defined(SYS_move_pages)
+
+namespace {
+
+  constexpr int MPOL_INTERLEAVE_MODE = 3; // From <linux/mempolicy.h>
+  constexpr size_t MaxNodes = 1024;
+
+  /// node_cpus() reads the cpus of each online NUMA node from sysfs. The result
+  /// is computed once, nodes without cpus (e.g. memory only) are skipped, so the
+  /// node ids, which may have gaps, are kept along with the cpus.
+
+  struct NodeCpus {
+    int id;
+    vector<int> cpus;
+  };
+
+  const vector<NodeCpus>& node_cpus() {
+
+    static const vector<NodeCpus> cpus = [] {
+
+      vector<NodeCpus> v;
+
+      for (size_t n = 0; n < MaxNodes; ++n)
+      {
+          ifstream file("/sys/devices/system/node/node" + to_string(n) + "/cpulist");
+          if (!file.is_open())
+              continue;
+
+          string list, range;
+          getline(file, list);
+          istringstream ss(list);
+          vector<int> node;
+
+          // The format is a comma separated list of ranges, like "0-15,32-47"
+          while (getline(ss, range, ','))
+          {
+              size_t dash = range.find('-');
+              int first = stoi(range), last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+              for (int c = first; c <= last; ++c)
+                  node.push_back(c);
+          }
+
+          if (!node.empty())
+              v.push_back({ int(n), node });
+      }
+      return v;
+    }();
+
+    return cpus;
+  }
+
+  size_t page_size() { return size_t(sysconf(_SC_PAGESIZE)); }
+
+} // namespace
+
+
+size_t nodes() { return std::max(node_cpus().size(), size_t(1)); }
+
+
+/// bind_this_thread() pins the calling thread to the cpus of a single NUMA node.
+/// Thread indices are mapped to nodes in contiguous blocks, so that the threads
+/// zeroing neighbouring parts of the hash table share a node. Returns the node
+/// id or -1 if there is nothing to bind to.
+
+int bind_this_thread(size_t idx, size_t threadCount) {
+
+  const auto& cpus = node_cpus();
+
+  if (cpus.size() < 2)
+      return -1;
+
+  const NodeCpus& node = cpus[idx * cpus.size() / std::max(threadCount, idx + 1)];
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int c : node.cpus)
+      if (c < CPU_SETSIZE)
+          CPU_SET(c, &set);
+
+  return sched_setaffinity(0, sizeof(set), &set) ? -1 : node.id;
+}
+
+
+/// interleave() sets an interleaved memory policy over all nodes with cpus for
+/// the given range. It only affects pages not yet touched, so call it before
+/// first use.
+
+void interleave(void* mem, size_t size) {
+
+  if (!mem || nodes() < 2)
+      return;
+
+  unsigned long mask[MaxNodes / (8 * sizeof(unsigned long))] = {};
+  for (const NodeCpus& node : node_cpus())
+      mask[node.id / (8 * sizeof(unsigned long))] |= 1UL << (node.id % (8 * sizeof(unsigned long)));
+
+  uintptr_t start = uintptr_t(mem) & ~(page_size() - 1);
+  syscall(SYS_mbind, (void*)start, uintptr_t(mem) + size - start, MPOL_INTERLEAVE_MODE,
+          mask, MaxNodes, 0);
+}
+
+
+/// remote_ratio() samples up to 1000 pages of the given range and returns the
+/// fraction of the resident ones that live on a node other than the node id
+/// 'node', as returned by bind_this_thread().
+
+double remote_ratio(const void* mem, size_t size, int node) {
+
+  if (!mem || node < 0 || nodes() < 2)
+      return 0.0;
+
+  const size_t pages = std::max(size / page_size(), size_t(1));
+  const size_t samples = std::min(pages, size_t(1000));
+  vector<void*> addr(samples);
+  vector<int> status(samples);
+
+  for (size_t i = 0; i < samples; ++i)
+      addr[i] = const_cast<char*>(static_cast<const char*>(mem)) + (i * pages / samples) * page_size();
+
+  if (syscall(SYS_move_pages, 0, samples, addr.data(), nullptr, status.data(), 0))
+      return 0.0;
+
+  size_t resident = 0, remote = 0;
+  for (int st : status)
+      if (st >= 0)
+          ++resident, remote += (st != node);
+
+  return resident ? double(remote) / resident : 0.0;
+}
+
+#else
+
+size_t nodes() { return 1; }
+int bind_this_thread(size_t, size_t) { return -1; }
+void interleave(void*, size_t) {}
+double remote_ratio(const void*, size_t, int) { return 0.0; }
+
+#endif
+
+} // namespace Numa
+
 #ifdef _WIN32
 #include <direct.h>
 #define GETCWD _getcwd
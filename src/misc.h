@@ -39,6 +39,49 @@ void std_aligned_free(void* ptr);
 void* aligned_large_pages_alloc(size_t size); // memory aligned by page size, min alignment: 4096 bytes
 void aligned_large_pages_free(void* mem); // nop if mem == nullptr
 
+/// CpuInfo holds the x86 instruction sets of the CPU we run on, read with cpuid.
+/// Builds with runtime dispatch use it to pick the NNUE code and pext.
+struct CpuInfo {
+  bool sse41, popcnt, avx2, bmi2, avx512, vnni512;
+  bool slowPext; // Microcoded, and slower than magics, on AMD before Zen 3
+};
+
+const CpuInfo& cpu_info();
+
+/// cpu_cycles() reads the time stamp counter on x86, which ticks at a constant
+/// rate close to the nominal clock of the CPU. It returns 0 elsewhere.
+uint64_t cpu_cycles();
+
+/// PerfCounters counts hardware events of the thread that opened it, with
+/// perf_event_open on Linux, between start() and stop(). Each event is opened
+/// on its own and scaled for multiplexing, so events the CPU or the kernel
+/// refuses are just not available. Elsewhere no event is ever available.
+struct PerfCounters {
+
+  enum Event { Cycles, Instructions, LLCMisses, DTLBMisses, BranchMisses, EVENT_NB };
+
+  PerfCounters() = default;
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+  ~PerfCounters() { close(); }
+
+  void open(); // Call from the thread to count
+  void close();
+  void start();
+  void stop(); // Sets 'last' and adds it to 'total'
+  void clear();
+  bool is_open() const { return opened; }
+  bool available(Event e) const { return fd[e] >= 0; }
+
+  static const char* name(Event e);
+
+  uint64_t last[EVENT_NB] = {}, total[EVENT_NB] = {};
+
+private:
+  int fd[EVENT_NB] = { -1, -1, -1, -1, -1 };
+  bool opened = false;
+};
+
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
 void dbg_mean_of(int v);
@@ -226,6 +269,17 @@ namespace WinProcGroup {
   void bindThisThread(size_t idx);
 }
 
+/// On Linux the NUMA topology is read from sysfs and memory policies are set
+/// with raw syscalls, so that no libnuma is needed. Elsewhere these are no-ops
+/// and the system is seen as a single node.
+
+namespace Numa {
+  size_t nodes();
+  int bind_this_thread(size_t idx, size_t threadCount);
+  void interleave(void* mem, size_t size);
+  double remote_ratio(const void* mem, size_t size, int node);
+}
+
 namespace CommandLine {
   void init(int argc, char* argv[]);
 
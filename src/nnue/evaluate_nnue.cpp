@@ -18,32 +18,55 @@
 
 // Code for calculating NNUE evaluation function
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <set>
 #include <sstream>
 #include <iomanip>
 #include <fstream>
+#include <type_traits>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "../evaluate.h"
 #include "../position.h"
 #include "../misc.h"
+#include "../movegen.h"
+#include "../thread.h"
 #include "../uci.h"
 #include "../types.h"
 
 #include "evaluate_nnue.h"
 
 namespace Stockfish::Eval::NNUE {
+NNUE_ARCH_BEGIN
 
-  // Input feature converter
-  LargePagePtr<FeatureTransformer> featureTransformer;
+  // Input feature converter and evaluation function read from a .nnue file
+  LargePagePtr<FeatureTransformer> transformerStorage;
+  AlignedPtr<Network> networkStorage[LayerStacks];
 
-  // Evaluation function
-  AlignedPtr<Network> network[LayerStacks];
+  // Parameters in use, either the ones above or those of a mapped network image
+  const FeatureTransformer* featureTransformer;
+  const Network* network[LayerStacks];
+
+  // Mapping of the network image in use, if any
+  void* mappedImage;
+  std::size_t mappedSize;
 
   // Evaluation function file name
   std::string fileName;
   std::string netDescription;
 
+  // Id of the loaded network, to tell when accumulator caches are outdated
+  std::uint32_t netId;
+
   namespace Detail {
 
   // Initialize the evaluation function parameters
@@ -80,14 +103,58 @@ namespace Stockfish::Eval::NNUE {
     return reference.write_parameters(stream);
   }
 
+  // Accumulator cache of the thread of the position, emptied if it was filled
+  // with another network
+  AccumulatorCache& accumulator_cache(const Position& pos) {
+
+    AccumulatorCache& cache = pos.this_thread()->accumulatorCache;
+
+    if (cache.netId != netId)
+    {
+        featureTransformer->clear(cache);
+        cache.netId = netId;
+    }
+    return cache;
+  }
+
+  // Evaluation cache of the thread of the position, emptied if it was filled
+  // with another network
+  EvalCache& eval_cache(const Position& pos) {
+
+    EvalCache& cache = pos.this_thread()->evalCache;
+
+    if (cache.netId != netId)
+    {
+        cache.clear();
+        cache.netId = netId;
+    }
+    return cache;
+  }
+
   }  // namespace Detail
 
+  // Release the network image in use, if any
+  void unmap_image() {
+
+#if !defined(_WIN32)
+    if (mappedImage)
+        munmap(mappedImage, mappedSize);
+#endif
+    mappedImage = nullptr;
+    mappedSize = 0;
+  }
+
   // Initialize the evaluation function parameters
   void initialize() {
 
-    Detail::initialize(featureTransformer);
+    unmap_image();
+    Detail::initialize(transformerStorage);
+    featureTransformer = transformerStorage.get();
     for (std::size_t i = 0; i < LayerStacks; ++i)
-      Detail::initialize(network[i]);
+    {
+      Detail::initialize(networkStorage[i]);
+      network[i] = networkStorage[i].get();
+    }
   }
 
   // Read network header
@@ -120,9 +187,9 @@ namespace Stockfish::Eval::NNUE {
     std::uint32_t hashValue;
     if (!read_header(stream, &hashValue, &netDescription)) return false;
     if (hashValue != HashValue) return false;
-    if (!Detail::read_parameters(stream, *featureTransformer)) return false;
+    if (!Detail::read_parameters(stream, *transformerStorage)) return false;
     for (std::size_t i = 0; i < LayerStacks; ++i)
-      if (!Detail::read_parameters(stream, *(network[i]))) return false;
+      if (!Detail::read_parameters(stream, *(networkStorage[i]))) return false;
     return stream && stream.peek() == std::ios::traits_type::eof();
   }
 
@@ -136,6 +203,74 @@ namespace Stockfish::Eval::NNUE {
     return (bool)stream;
   }
 
+  // A network image holds the parameters as they are laid out in memory, after
+  // the permutations of read_parameters(), so that it can be mapped read-only
+  // and used in place: the processes using the same image then share its pages.
+  // The layout depends on the SIMD code compiled in, hence an image is only
+  // valid for builds of the same ImageLayout.
+
+  struct ImageHeader {
+    char magic[8];
+    std::uint32_t byteOrder, version, hashValue, layout;
+    std::uint64_t transformerSize, networkSize;
+    std::uint64_t transformerOffset, networkOffset, fileSize;
+    std::uint32_t descriptionSize;
+  };
+
+  constexpr char ImageMagic[8] = "SFNNIMG";
+  constexpr std::uint32_t ImageByteOrder = 0x01020304;
+  constexpr std::size_t ImageAlignment = 4096;
+
+#if defined(USE_AVX512)
+  constexpr std::uint32_t ImageLayout = 5;
+#elif defined(USE_AVX2)
+  constexpr std::uint32_t ImageLayout = 4;
+#elif defined(USE_SSSE3)
+  constexpr std::uint32_t ImageLayout = 3;
+#elif defined(USE_NEON)
+  constexpr std::uint32_t ImageLayout = 2;
+#else
+  constexpr std::uint32_t ImageLayout = 1;
+#endif
+
+  static_assert(std::is_trivially_copyable_v<FeatureTransformer> && std::is_trivially_copyable_v<Network>,
+                "The parameters must be usable from a raw copy");
+
+  // Header of an image of the current network
+  ImageHeader image_header() {
+
+    ImageHeader h{};
+    std::memcpy(h.magic, ImageMagic, sizeof(h.magic));
+    h.byteOrder = ImageByteOrder;
+    h.version = Version;
+    h.hashValue = HashValue;
+    h.layout = ImageLayout;
+    h.transformerSize = sizeof(FeatureTransformer);
+    h.networkSize = sizeof(Network);
+    h.transformerOffset = ImageAlignment;
+    h.networkOffset = ceil_to_multiple<std::uint64_t>(h.transformerOffset + h.transformerSize, std::uint64_t(ImageAlignment));
+    h.fileSize = h.networkOffset + LayerStacks * h.networkSize;
+    h.descriptionSize = std::uint32_t(std::min(netDescription.size(), ImageAlignment - sizeof(ImageHeader)));
+    return h;
+  }
+
+  // Check that an image of 'size' bytes with header 'h' fits this build
+  bool image_matches(const ImageHeader& h, std::size_t size) {
+
+    ImageHeader expected = image_header();
+
+    return   h.byteOrder == ImageByteOrder
+          && h.version == Version
+          && h.hashValue == HashValue
+          && h.layout == ImageLayout
+          && h.transformerSize == expected.transformerSize
+          && h.networkSize == expected.networkSize
+          && h.transformerOffset == expected.transformerOffset
+          && h.networkOffset == expected.networkOffset
+          && h.fileSize == size
+          && h.descriptionSize <= ImageAlignment - sizeof(ImageHeader);
+  }
+
   // Evaluation function. Perform differential calculation.
   Value evaluate(const Position& pos, bool adjusted, int* complexity) {
 
@@ -157,9 +292,25 @@ namespace Stockfish::Eval::NNUE {
 
     ASSERT_ALIGNED(transformedFeatures, alignment);
 
-    const int bucket = (pos.count<ALL_PIECES>() - 1) / 4;
-    const auto psqt = featureTransformer->transform(pos, transformedFeatures, bucket);
-    const auto positional = network[bucket]->propagate(transformedFeatures);
+    std::int32_t psqt, positional;
+    bool found;
+    EvalCache::Entry* e = Detail::eval_cache(pos).probe(pos.state()->key, found);
+
+    if (found)
+    {
+        psqt = e->psqt;
+        positional = e->positional;
+    }
+    else
+    {
+        const int bucket = (pos.count<ALL_PIECES>() - 1) / 4;
+        psqt = featureTransformer->transform(pos, Detail::accumulator_cache(pos), pos.this_thread()->accumulatorStats,
+                                             transformedFeatures, bucket);
+        positional = network[bucket]->propagate(transformedFeatures);
+
+        if (e)
+            *e = { pos.state()->key, psqt, positional };
+    }
 
     if (complexity)
         *complexity = abs(psqt - positional) / OutputScale;
@@ -171,6 +322,68 @@ namespace Stockfish::Eval::NNUE {
         return static_cast<Value>((psqt + positional) / OutputScale);
   }
 
+  // Batched evaluation function. The positions are transformed a tile of
+  // Network::MaxBatchSize at a time, in the given order, which keeps the
+  // refreshes from the accumulator cache as cheap as for evaluate(pos) when
+  // consecutive positions are alike. Then the positions of the tile sharing a
+  // layer stack are propagated together, loading the weights of each layer
+  // once for all of them. Each position needs its own accumulator. The values
+  // are the same as those of evaluate(pos).
+  void evaluate(const Position* const* positions, std::size_t count, Value* values) {
+
+    constexpr uint64_t alignment = CacheLineSize;
+    constexpr std::size_t BatchSize = Network::MaxBatchSize;
+
+#if defined(ALIGNAS_ON_STACK_VARIABLES_BROKEN)
+    TransformedFeatureType transformedFeaturesUnaligned[
+      BatchSize * FeatureTransformer::BufferSize + alignment / sizeof(TransformedFeatureType)];
+
+    auto* transformedFeatures = align_ptr_up<alignment>(&transformedFeaturesUnaligned[0]);
+#else
+    alignas(alignment)
+      TransformedFeatureType transformedFeatures[BatchSize * FeatureTransformer::BufferSize];
+#endif
+
+    ASSERT_ALIGNED(transformedFeatures, alignment);
+
+    const TransformedFeatureType* inputs[BatchSize];
+    std::int32_t psqt[BatchSize], positional[BatchSize];
+    std::size_t index[BatchSize];
+    int buckets[BatchSize];
+
+    for (std::size_t start = 0; start < count; start += BatchSize)
+    {
+        const std::size_t n = std::min(BatchSize, count - start);
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const Position& pos = *positions[start + i];
+            buckets[i] = (pos.count<ALL_PIECES>() - 1) / 4;
+            psqt[i] = featureTransformer->transform(pos, Detail::accumulator_cache(pos), pos.this_thread()->accumulatorStats,
+                                                    transformedFeatures + i * FeatureTransformer::BufferSize, buckets[i]);
+        }
+
+        for (int bucket = 0; bucket < int(LayerStacks); ++bucket)
+        {
+            std::size_t m = 0;
+            for (std::size_t i = 0; i < n; ++i)
+                if (buckets[i] == bucket)
+                {
+                    index[m] = i;
+                    inputs[m++] = transformedFeatures + i * FeatureTransformer::BufferSize;
+                }
+
+            if (!m)
+                continue;
+
+            network[bucket]->propagate(inputs, m, positional);
+
+            for (std::size_t j = 0; j < m; ++j)
+                values[start + index[j]] = static_cast<Value>((psqt[index[j]] + positional[j]) / OutputScale);
+        }
+    }
+  }
+
   struct NnueEvalTrace {
     static_assert(LayerStacks == PSQTBuckets);
 
@@ -201,7 +414,8 @@ namespace Stockfish::Eval::NNUE {
     NnueEvalTrace t{};
     t.correctBucket = (pos.count<ALL_PIECES>() - 1) / 4;
     for (IndexType bucket = 0; bucket < LayerStacks; ++bucket) {
-      const auto materialist = featureTransformer->transform(pos, transformedFeatures, bucket);
+      const auto materialist = featureTransformer->transform(pos, Detail::accumulator_cache(pos), pos.this_thread()->accumulatorStats,
+                                                             transformedFeatures, bucket);
       const auto positional = network[bucket]->propagate(transformedFeatures);
 
       t.psqt[bucket] = static_cast<Value>( materialist / OutputScale );
@@ -286,7 +500,7 @@ namespace Stockfish::Eval::NNUE {
 
     // We estimate the value of each piece by doing a differential evaluation from
     // the current base eval, simulating the removal of the piece from its square.
-    Value base = evaluate(pos);
+    Value base = evaluate(pos, false, nullptr);
     base = pos.side_to_move() == WHITE ? base : -base;
 
     for (File f = FILE_A; f <= FILE_H; ++f)
@@ -301,16 +515,16 @@ namespace Stockfish::Eval::NNUE {
           auto st = pos.state();
 
           pos.remove_piece(sq);
-          st->accumulator.computed[WHITE] = false;
-          st->accumulator.computed[BLACK] = false;
+          st->accumulator->computed[WHITE] = false;
+          st->accumulator->computed[BLACK] = false;
 
-          Value eval = evaluate(pos);
+          Value eval = evaluate(pos, false, nullptr);
           eval = pos.side_to_move() == WHITE ? eval : -eval;
           v = base - eval;
 
           pos.put_piece(pc, sq);
-          st->accumulator.computed[WHITE] = false;
-          st->accumulator.computed[BLACK] = false;
+          st->accumulator->computed[WHITE] = false;
+          st->accumulator->computed[BLACK] = false;
         }
 
         writeSquare(f, r, pc, v);
@@ -355,14 +569,388 @@ namespace Stockfish::Eval::NNUE {
   }
 
 
+  // benchmark() evaluates the position 'iterations' times and adds to 'stats'
+  // the time spent, together with the number of 4-byte blocks of the input of
+  // the first affine layer and how many of them are non-zero. The accumulator
+  // is computed once up front, so the timing is that of the clipped product of
+  // the feature transformer and of the layers, where the sparse input pays off.
+
+  void benchmark(const Position& pos, int iterations, BenchmarkStats& stats) {
+
+    constexpr uint64_t alignment = CacheLineSize;
+
+#if defined(ALIGNAS_ON_STACK_VARIABLES_BROKEN)
+    TransformedFeatureType transformedFeaturesUnaligned[
+      FeatureTransformer::BufferSize + alignment / sizeof(TransformedFeatureType)];
+
+    auto* transformedFeatures = align_ptr_up<alignment>(&transformedFeaturesUnaligned[0]);
+#else
+    alignas(alignment)
+      TransformedFeatureType transformedFeatures[FeatureTransformer::BufferSize];
+#endif
+
+    ASSERT_ALIGNED(transformedFeatures, alignment);
+
+    AccumulatorStats accStats{};
+    auto& cache = Detail::accumulator_cache(pos);
+    const int bucket = (pos.count<ALL_PIECES>() - 1) / 4;
+
+    featureTransformer->transform(pos, cache, accStats, transformedFeatures, bucket);
+
+    const auto blocks = reinterpret_cast<const std::uint32_t*>(transformedFeatures);
+    constexpr IndexType NumBlocks = TransformedFeatureDimensions * sizeof(TransformedFeatureType) / 4;
+    for (IndexType i = 0; i < NumBlocks; ++i)
+        stats.nonZeroBlocks += blocks[i] != 0;
+    stats.blocks += NumBlocks;
+
+    std::int32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        sum += featureTransformer->transform(pos, cache, accStats, transformedFeatures, bucket);
+        sum += network[bucket]->propagate(transformedFeatures);
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    stats.evaluations += iterations;
+    stats.checksum += sum; // Keeps the loop from being optimized away
+  }
+
+
+  namespace Detail {
+
+  // Calls 'kernel' 'iterations' times and adds the time taken to 'stats', with
+  // 'bytes' the memory read and written by one call
+  template<typename Kernel>
+  void time_kernel(LayerStats& stats, int iterations, std::uint64_t bytes, Kernel kernel) {
+
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t cycles = cpu_cycles();
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        kernel();
+
+        // The calls have the same inputs, keep the compiler from merging them
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    stats.cycles += cpu_cycles() - cycles;
+    stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start).count();
+    stats.calls += iterations;
+    stats.bytes += bytes * iterations;
+  }
+
+  // Bytes of the inputs and outputs of a layer
+  template<typename Layer>
+  constexpr std::uint64_t io_bytes() {
+    return Layer::InputDimensions  * sizeof(typename Layer::InputType)
+         + Layer::OutputDimensions * sizeof(typename Layer::OutputType);
+  }
+
+  // Bytes of the weights and biases of a dense affine layer
+  template<typename Layer>
+  constexpr std::uint64_t parameter_bytes() {
+    return Layer::OutputDimensions * (Layer::PaddedInputDimensions + sizeof(typename Layer::OutputType));
+  }
+
+  }  // namespace Detail
+
+
+  // benchmark_layers() times in isolation each kernel of the evaluation, on the
+  // inputs it gets when evaluating the positions of 'fens': the refresh of both
+  // accumulators from empty cache entries (the copy of the biases emptying them
+  // is timed too), their incremental update after each legal move that is not a
+  // king move, the clipped product of the feature transformer and the layers
+  // of the network. Each kernel is called 'iterations' times per input. The
+  // bytes of a call are those of the weights it reads, of its inputs and of its
+  // outputs.
+
+  void benchmark_layers(const std::vector<std::string>& fens, int iterations,
+                        std::vector<LayerStats>& stats) {
+
+    using Fc0 = decltype(Network::fc_0);
+    using AcSqr0 = decltype(Network::ac_sqr_0);
+    using Ac0 = decltype(Network::ac_0);
+    using Fc1 = decltype(Network::fc_1);
+    using Ac1 = decltype(Network::ac_1);
+    using Fc2 = decltype(Network::fc_2);
+
+    enum { Refresh, Update, Transform, Fc_0, AcSqr_0, Ac_0, Fc_1, Ac_1, Fc_2 };
+
+    auto dims = [](IndexType in, IndexType out = 0) {
+      return "<" + std::to_string(in) + (out ? ", " + std::to_string(out) : "") + ">";
+    };
+
+    stats = {
+      { "update_accumulator, refresh"     , 0, 0, 0, 0 },
+      { "update_accumulator, incremental" , 0, 0, 0, 0 },
+      { "FeatureTransformer::transform"   , 0, 0, 0, 0 },
+      { "fc_0 AffineTransformSparseInput" + dims(Fc0::InputDimensions, Fc0::OutputDimensions), 0, 0, 0, 0 },
+      { "ac_sqr_0 SqrClippedReLU"         + dims(AcSqr0::InputDimensions), 0, 0, 0, 0 },
+      { "ac_0 ClippedReLU"                + dims(Ac0::InputDimensions), 0, 0, 0, 0 },
+      { "fc_1 AffineTransform"            + dims(Fc1::InputDimensions, Fc1::OutputDimensions), 0, 0, 0, 0 },
+      { "ac_1 ClippedReLU"                + dims(Ac1::InputDimensions), 0, 0, 0, 0 },
+      { "fc_2 AffineTransform"            + dims(Fc2::InputDimensions, Fc2::OutputDimensions), 0, 0, 0, 0 },
+    };
+
+    // The weights of a feature and an accumulator of one perspective have the
+    // same size
+    constexpr std::uint64_t RowBytes =  sizeof(Accumulator::accumulation[0])
+                                      + sizeof(Accumulator::psqtAccumulation[0]);
+
+    // The accumulators, of the root and of a child, are our own so that they
+    // are not shared with a search running meanwhile
+    struct alignas(CacheLineSize) Buffers {
+      TransformedFeatureType transformedFeatures[FeatureTransformer::BufferSize];
+      Network::Buffer layers;
+      Accumulator accumulators[2];
+    };
+
+    auto buffers = std::make_unique<Buffers>();
+    auto cache = std::make_unique<AccumulatorCache>();
+    AccumulatorStats accStats{};
+    featureTransformer->clear(*cache);
+
+    TransformedFeatureType* transformedFeatures = buffers->transformedFeatures;
+    Network::Buffer& buffer = buffers->layers;
+
+    for (const auto& fen : fens)
+    {
+        StateInfo states[2];
+        Position pos;
+        pos.set(fen, Options["UCI_Chess960"], &states[0], Threads.main());
+
+        states[0].accumulator = &buffers->accumulators[0];
+        Accumulator& root = *states[0].accumulator;
+
+        const Square ksq[COLOR_NB] = { pos.square<KING>(WHITE), pos.square<KING>(BLACK) };
+        const std::uint64_t pieces = pos.count<ALL_PIECES>();
+
+        // Per perspective, the weights of all the pieces, and the cache entry
+        // read and written together with the accumulator
+        Detail::time_kernel(stats[Refresh], iterations, 2 * (pieces + 3) * RowBytes, [&] {
+            featureTransformer->clear(cache->entries[ksq[WHITE]][WHITE]);
+            featureTransformer->clear(cache->entries[ksq[BLACK]][BLACK]);
+            root.computed[WHITE] = root.computed[BLACK] = false;
+            featureTransformer->update_accumulators(pos, *cache, accStats);
+        });
+
+        for (const auto& m : MoveList<LEGAL>(pos))
+        {
+            pos.do_move(m, states[1]);
+
+            if (   !FeatureSet::requires_refresh(&states[1], WHITE)
+                && !FeatureSet::requires_refresh(&states[1], BLACK))
+            {
+                // Per perspective, the weights of the features changed, and the
+                // accumulator of the parent read and that of the child written
+                std::uint64_t bytes = 0;
+                for (Color perspective : { WHITE, BLACK })
+                {
+                    FeatureSet::IndexList removed, added;
+                    FeatureSet::append_changed_indices(ksq[perspective], states[1].dirtyPiece,
+                                                       perspective, removed, added);
+                    bytes += (removed.size() + added.size() + 2) * RowBytes;
+                }
+
+                Accumulator& child = *states[1].accumulator;
+                Detail::time_kernel(stats[Update], iterations, bytes, [&] {
+                    child.computed[WHITE] = child.computed[BLACK] = false;
+                    featureTransformer->update_accumulators(pos, *cache, accStats);
+                });
+            }
+
+            pos.undo_move(m);
+        }
+
+        const int bucket = (pos.count<ALL_PIECES>() - 1) / 4;
+        const Network& net = *network[bucket];
+
+        // Both accumulators and a PSQT bucket of each are read
+        Detail::time_kernel(stats[Transform], iterations,
+                            sizeof(root.accumulation) + 2 * sizeof(std::int32_t) + FeatureTransformer::BufferSize, [&] {
+            featureTransformer->transform(pos, *cache, accStats, transformedFeatures, bucket);
+        });
+
+        // The sparse layer reads the weights of the non-zero input chunks only
+        std::uint64_t fc0Weights = Fc0::OutputDimensions * Fc0::PaddedInputDimensions;
+#if defined(USE_SSSE3)
+        const auto chunks = reinterpret_cast<const std::uint32_t*>(transformedFeatures);
+        fc0Weights = 0;
+        for (IndexType i = 0; i < Fc0::PaddedInputDimensions / Fc0::ChunkSize; ++i)
+            fc0Weights += chunks[i] ? Fc0::OutputDimensions * Fc0::ChunkSize : 0;
+#endif
+
+        Detail::time_kernel(stats[Fc_0], iterations,
+                            Detail::io_bytes<Fc0>() + fc0Weights + Fc0::OutputDimensions * sizeof(Fc0::OutputType), [&] {
+            net.fc_0.propagate(transformedFeatures, buffer.fc_0_out);
+        });
+
+        Detail::time_kernel(stats[AcSqr_0], iterations, Detail::io_bytes<AcSqr0>(), [&] {
+            net.ac_sqr_0.propagate(buffer.fc_0_out, buffer.ac_sqr_0_out);
+        });
+
+        Detail::time_kernel(stats[Ac_0], iterations, Detail::io_bytes<Ac0>(), [&] {
+            net.ac_0.propagate(buffer.fc_0_out, buffer.ac_0_out);
+        });
+
+        std::memcpy(buffer.ac_sqr_0_out + Network::FC_0_OUTPUTS, buffer.ac_0_out,
+                    Network::FC_0_OUTPUTS * sizeof(Ac0::OutputType));
+
+        Detail::time_kernel(stats[Fc_1], iterations, Detail::io_bytes<Fc1>() + Detail::parameter_bytes<Fc1>(), [&] {
+            net.fc_1.propagate(buffer.ac_sqr_0_out, buffer.fc_1_out);
+        });
+
+        Detail::time_kernel(stats[Ac_1], iterations, Detail::io_bytes<Ac1>(), [&] {
+            net.ac_1.propagate(buffer.fc_1_out, buffer.ac_1_out);
+        });
+
+        Detail::time_kernel(stats[Fc_2], iterations, Detail::io_bytes<Fc2>() + Detail::parameter_bytes<Fc2>(), [&] {
+            net.fc_2.propagate(buffer.ac_1_out, buffer.fc_2_out);
+        });
+    }
+  }
+
+#if !defined(USE_DISPATCH)
+
+  // The SIMD code of the layers compiled in
+#if defined(USE_AVX512) && defined(USE_VNNI)
+  constexpr const char* SimdName = "vnni512";
+#elif defined(USE_AVX512)
+  constexpr const char* SimdName = "avx512";
+#elif defined(USE_AVX2) && defined(USE_VNNI)
+  constexpr const char* SimdName = "avxvnni";
+#elif defined(USE_AVX2)
+  constexpr const char* SimdName = "avx2";
+#elif defined(USE_SSE41)
+  constexpr const char* SimdName = "sse41";
+#elif defined(USE_SSSE3)
+  constexpr const char* SimdName = "ssse3";
+#elif defined(USE_SSE2)
+  constexpr const char* SimdName = "sse2";
+#elif defined(USE_MMX)
+  constexpr const char* SimdName = "mmx";
+#elif defined(USE_NEON)
+  constexpr const char* SimdName = "neon";
+#else
+  constexpr const char* SimdName = "generic";
+#endif
+
+  std::vector<LayerBenchmark> benchmark_layers(const std::vector<std::string>& fens, int iterations) {
+
+    LayerBenchmark result{ SimdName, {} };
+    benchmark_layers(fens, iterations, result.layers);
+    return { result };
+  }
+
+#endif
+
+
   // Load eval, from a file stream or a memory stream
   bool load_eval(std::string name, std::istream& stream) {
 
     initialize();
     fileName = name;
+    ++netId;
     return read_parameters(stream);
   }
 
+  // Load eval from a network image, mapped in place where mmap() is available
+  // and otherwise copied. Returns false, leaving the network in use untouched,
+  // if the file is not an image for this build.
+  bool load_image(std::string name, const std::string& path) {
+
+    ImageHeader h;
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    std::size_t size = stream ? std::size_t(stream.tellg()) : 0;
+
+    if (   size < ImageAlignment
+        || !stream.seekg(0).read(reinterpret_cast<char*>(&h), sizeof(h))
+        || std::memcmp(h.magic, ImageMagic, sizeof(h.magic)))
+        return false;
+
+    if (!image_matches(h, size))
+    {
+        sync_cout << "info string " << path << " is a network image for another build, "
+                  << "export it again from the .nnue file" << sync_endl;
+        return false;
+    }
+
+    std::string description(h.descriptionSize, '\0');
+    stream.seekg(sizeof(h)).read(&description[0], h.descriptionSize);
+
+#if !defined(_WIN32)
+    int fd = open(path.c_str(), O_RDONLY);
+    void* mem = fd == -1 ? MAP_FAILED : mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (fd != -1)
+        close(fd);
+
+    if (mem == MAP_FAILED || !stream)
+    {
+        if (mem != MAP_FAILED)
+            munmap(mem, size);
+        return false;
+    }
+
+    unmap_image();
+    transformerStorage.reset();
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+        networkStorage[i].reset();
+
+    mappedImage = mem;
+    mappedSize = size;
+
+    const char* base = static_cast<const char*>(mem);
+    featureTransformer = reinterpret_cast<const FeatureTransformer*>(base + h.transformerOffset);
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+        network[i] = reinterpret_cast<const Network*>(base + h.networkOffset + i * h.networkSize);
+#else
+    initialize();
+    stream.seekg(h.transformerOffset).read(reinterpret_cast<char*>(transformerStorage.get()), h.transformerSize);
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+        stream.seekg(h.networkOffset + i * h.networkSize)
+              .read(reinterpret_cast<char*>(networkStorage[i].get()), h.networkSize);
+
+    if (!stream)
+        return false;
+#endif
+
+    fileName = name;
+    netDescription = description;
+    ++netId;
+    return true;
+  }
+
+  // Save the network in use as an image, see ImageHeader
+  bool save_image(const std::string& filename) {
+
+    if (fileName.empty())
+        return false;
+
+    const ImageHeader h = image_header();
+    const std::string padding(ImageAlignment, '\0');
+    std::ofstream stream(filename, std::ios::binary);
+
+    stream.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    stream.write(netDescription.data(), h.descriptionSize);
+    stream.write(padding.data(), h.transformerOffset - sizeof(h) - h.descriptionSize);
+    stream.write(reinterpret_cast<const char*>(featureTransformer), h.transformerSize);
+    stream.write(padding.data(), h.networkOffset - h.transformerOffset - h.transformerSize);
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+        stream.write(reinterpret_cast<const char*>(network[i]), h.networkSize);
+
+    bool saved = bool(stream);
+
+    sync_cout << (saved ? "Network image saved successfully to " + filename
+                        : "Failed to export a network image") << sync_endl;
+    return saved;
+  }
+
   // Save eval, to a file stream or a memory stream
   bool save_eval(std::ostream& stream) {
 
@@ -402,5 +990,31 @@ namespace Stockfish::Eval::NNUE {
     return saved;
   }
 
+#if defined(NNUE_ARCH)
+
+  #define stringify2(x) #x
+  #define stringify(x) stringify2(x)
+
+  // Free the network of this copy of the code, when it is not the one in use
+  void release() {
+
+    unmap_image();
+    transformerStorage.reset();
+    featureTransformer = nullptr;
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+    {
+      networkStorage[i].reset();
+      network[i] = nullptr;
+    }
+    fileName.clear();
+  }
+
+  // The entry points of this copy of the code, see nnue_dispatch.cpp
+  extern const Arch arch;
+  const Arch arch = { stringify(NNUE_ARCH), trace, benchmark, benchmark_layers, evaluate, evaluate,
+                      load_eval, load_image, save_image, save_eval, save_eval, release };
+
+#endif
 
+NNUE_ARCH_END
 } // namespace Stockfish::Eval::NNUE
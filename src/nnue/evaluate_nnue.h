@@ -26,6 +26,7 @@
 #include <memory>
 
 namespace Stockfish::Eval::NNUE {
+NNUE_ARCH_BEGIN
 
   // Hash value of evaluation function structure
   constexpr std::uint32_t HashValue =
@@ -54,6 +55,7 @@ namespace Stockfish::Eval::NNUE {
   template <typename T>
   using LargePagePtr = std::unique_ptr<T, LargePageDeleter<T>>;
 
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // #ifndef NNUE_EVALUATE_NNUE_H_INCLUDED
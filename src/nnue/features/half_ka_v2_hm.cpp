@@ -23,17 +23,7 @@
 #include "../../position.h"
 
 namespace Stockfish::Eval::NNUE::Features {
-
-  // Orient a square according to perspective (rotates by 180 for black)
-  inline Square HalfKAv2_hm::orient(Color perspective, Square s, Square ksq) {
-    return Square(int(s) ^ (bool(perspective) * SQ_A8) ^ ((file_of(ksq) < FILE_E) * SQ_H1));
-  }
-
-  // Index of a feature for a given king position and another piece on some square
-  inline IndexType HalfKAv2_hm::make_index(Color perspective, Square s, Piece pc, Square ksq) {
-    Square o_ksq = orient(perspective, ksq, ksq);
-    return IndexType(orient(perspective, s, ksq) + PieceSquareIndex[perspective][pc] + PS_NB * KingBuckets[o_ksq]);
-  }
+NNUE_ARCH_BEGIN
 
   // Get a list of indices for active features
   void HalfKAv2_hm::append_active_indices(
@@ -80,4 +70,5 @@ namespace Stockfish::Eval::NNUE::Features {
     return st->dirtyPiece.piece[0] == make_piece(perspective, KING);
   }
 
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE::Features
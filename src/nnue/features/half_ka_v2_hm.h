@@ -31,6 +31,7 @@ namespace Stockfish {
 }
 
 namespace Stockfish::Eval::NNUE::Features {
+NNUE_ARCH_BEGIN
 
   // Feature HalfKAv2_hm: Combination of the position of own king
   // and the position of pieces. Position mirrored such that king always on e..h files.
@@ -65,10 +66,10 @@ namespace Stockfish::Eval::NNUE::Features {
     // Orient a square according to perspective (rotates by 180 for black)
     static Square orient(Color perspective, Square s, Square ksq);
 
+   public:
     // Index of a feature for a given king position and another piece on some square
     static IndexType make_index(Color perspective, Square s, Piece pc, Square ksq);
 
-   public:
     // Feature name
     static constexpr const char* Name = "HalfKAv2_hm(Friend)";
 
@@ -119,6 +120,18 @@ namespace Stockfish::Eval::NNUE::Features {
     static bool requires_refresh(const StateInfo* st, Color perspective);
   };
 
+  // Orient a square according to perspective (rotates by 180 for black)
+  inline Square HalfKAv2_hm::orient(Color perspective, Square s, Square ksq) {
+    return Square(int(s) ^ (bool(perspective) * SQ_A8) ^ ((file_of(ksq) < FILE_E) * SQ_H1));
+  }
+
+  // Index of a feature for a given king position and another piece on some square
+  inline IndexType HalfKAv2_hm::make_index(Color perspective, Square s, Piece pc, Square ksq) {
+    Square o_ksq = orient(perspective, ksq, ksq);
+    return IndexType(orient(perspective, s, ksq) + PieceSquareIndex[perspective][pc] + PS_NB * KingBuckets[o_ksq]);
+  }
+
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE::Features
 
 #endif // #ifndef NNUE_FEATURES_HALF_KA_V2_HM_H_INCLUDED
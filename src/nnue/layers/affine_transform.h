@@ -54,6 +54,7 @@
 */
 
 namespace Stockfish::Eval::NNUE::Layers {
+NNUE_ARCH_BEGIN
 
 // Fallback implementation for older/other architectures.
 // Identical for both approaches. Requires the input to be padded to at least 16 values.
@@ -534,6 +535,7 @@ namespace Stockfish::Eval::NNUE::Layers {
     alignas(CacheLineSize) WeightType weights[OutputDimensions * PaddedInputDimensions];
   };
 
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE::Layers
 
 #endif // #ifndef NNUE_LAYERS_AFFINE_TRANSFORM_H_INCLUDED
@@ -0,0 +1,294 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2022 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Definition of layer AffineTransformSparseInput of NNUE evaluation function
+
+#ifndef NNUE_LAYERS_AFFINE_TRANSFORM_SPARSE_INPUT_H_INCLUDED
+#define NNUE_LAYERS_AFFINE_TRANSFORM_SPARSE_INPUT_H_INCLUDED
+
+#include <iostream>
+#include <algorithm>
+#include <type_traits>
+#include "../nnue_common.h"
+#include "affine_transform.h"
+#include "../../simd.h"
+
+/*
+  This file contains the definition for a fully connected layer (aka affine transform)
+  whose input is expected to be mostly zeros, as is the output of the feature
+  transformer after the clipped multiplication.
+
+    - the input is viewed as an array of int32 chunks of 4 bytes each
+    - a first pass finds the indices of the non-zero chunks with a SIMD compare
+      and a movemask, turning each 8 bit mask into up to 8 indices with a table
+    - the weights are stored chunk major (the same layout as the small layers of
+      AffineTransform), so the weights of one chunk for all outputs are contiguous
+    - a second pass accumulates only the weight columns of the non-zero chunks,
+      broadcasting the 4 input bytes against them, two chunks at a time,
+      directly into int32s
+
+  The file format and the hash are the same as for AffineTransform, only the
+  order in which the weights are kept in memory differs.
+*/
+
+namespace Stockfish::Eval::NNUE::Layers {
+NNUE_ARCH_BEGIN
+
+#if defined (USE_SSSE3)
+
+  // For each 8 bit mask, the positions of its set bits and their number
+  struct NnzLookup {
+    alignas(16) std::uint16_t indices[256][8];
+    std::uint8_t count[256];
+
+    constexpr NnzLookup() : indices(), count() {
+      for (unsigned i = 0; i < 256; ++i)
+      {
+          unsigned j = i, k = 0;
+          while (j)
+          {
+              unsigned lsbIndex = 0;
+              while (!((j >> lsbIndex) & 1))
+                  ++lsbIndex;
+              j &= j - 1;
+              indices[i][k++] = std::uint16_t(lsbIndex);
+          }
+          count[i] = std::uint8_t(k);
+      }
+    }
+  };
+
+  constexpr NnzLookup NnzTable;
+
+  // Writes to 'out' the indices of the non-zero int32 values of 'input' and
+  // returns their number. The values must be non-negative, which holds for the
+  // clipped uint8 chunks this is used on (each byte is at most 127). 'out' is
+  // written 8 indices at a time, so it must have room for InputDimensions values.
+  template<IndexType InputDimensions>
+  IndexType find_nnz(const std::int32_t* input, std::uint16_t* out) {
+
+#if defined (USE_AVX512)
+    using vec_t = __m512i;
+    #define vec_nnz(a) _mm512_cmpgt_epi32_mask(a, _mm512_setzero_si512())
+#elif defined (USE_AVX2)
+    using vec_t = __m256i;
+    #define vec_nnz(a) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, _mm256_setzero_si256())))
+#else
+    using vec_t = __m128i;
+    #define vec_nnz(a) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a, _mm_setzero_si128())))
+#endif
+
+    constexpr IndexType InputSimdWidth = sizeof(vec_t) / sizeof(std::int32_t);
+    // Masks are consumed 8 bits at a time, so work on at least 8 inputs per step
+    constexpr IndexType ChunkSize = std::max<IndexType>(InputSimdWidth, 8);
+    constexpr IndexType NumChunks = InputDimensions / ChunkSize;
+    constexpr IndexType InputsPerChunk = ChunkSize / InputSimdWidth;
+    constexpr IndexType OutputsPerChunk = ChunkSize / 8;
+
+    static_assert(InputDimensions % ChunkSize == 0);
+
+    const auto inputVector = reinterpret_cast<const vec_t*>(input);
+    const __m128i increment = _mm_set1_epi16(8);
+    __m128i base = _mm_setzero_si128();
+    IndexType count = 0;
+
+    for (IndexType i = 0; i < NumChunks; ++i)
+    {
+        unsigned nnz = 0;
+        for (IndexType j = 0; j < InputsPerChunk; ++j)
+            nnz |= unsigned(vec_nnz(inputVector[i * InputsPerChunk + j])) << (j * InputSimdWidth);
+
+        for (IndexType j = 0; j < OutputsPerChunk; ++j)
+        {
+            const unsigned lookup = (nnz >> (j * 8)) & 0xFF;
+            const __m128i offsets = _mm_load_si128(reinterpret_cast<const __m128i*>(NnzTable.indices[lookup]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + count), _mm_add_epi16(base, offsets));
+            count += NnzTable.count[lookup];
+            base = _mm_add_epi16(base, increment);
+        }
+    }
+
+# undef vec_nnz
+
+    return count;
+  }
+
+#endif
+
+  template <IndexType InDims, IndexType OutDims>
+  class AffineTransformSparseInput {
+   public:
+    // Input/output type
+    using InputType = std::uint8_t;
+    using OutputType = std::int32_t;
+
+    // Number of input/output dimensions
+    static constexpr IndexType InputDimensions = InDims;
+    static constexpr IndexType OutputDimensions = OutDims;
+
+    static constexpr IndexType PaddedInputDimensions =
+      ceil_to_multiple<IndexType>(InputDimensions, MaxSimdWidth);
+    static constexpr IndexType PaddedOutputDimensions =
+      ceil_to_multiple<IndexType>(OutputDimensions, MaxSimdWidth);
+
+    using OutputBuffer = OutputType[PaddedOutputDimensions];
+
+    // Number of input bytes sharing one int32 broadcast
+    static constexpr IndexType ChunkSize = 4;
+
+    // Hash value embedded in the evaluation file
+    static constexpr std::uint32_t get_hash_value(std::uint32_t prevHash) {
+      std::uint32_t hashValue = 0xCC03DAE4u;
+      hashValue += OutputDimensions;
+      hashValue ^= prevHash >> 1;
+      hashValue ^= prevHash << 31;
+      return hashValue;
+    }
+
+    /*
+      Maps the row major index of the file to a chunk major one: the weights
+      of input chunk c for all the outputs are stored at c * OutputDimensions * 4.
+    */
+    static IndexType get_weight_index_scrambled(IndexType i)
+    {
+      return
+        (i / ChunkSize) % (PaddedInputDimensions / ChunkSize) * OutputDimensions * ChunkSize +
+        i / PaddedInputDimensions * ChunkSize +
+        i % ChunkSize;
+    }
+
+    static IndexType get_weight_index(IndexType i)
+    {
+#if defined (USE_SSSE3)
+      return get_weight_index_scrambled(i);
+#else
+      return i;
+#endif
+    }
+
+    // Read network parameters
+    bool read_parameters(std::istream& stream) {
+      for (IndexType i = 0; i < OutputDimensions; ++i)
+        biases[i] = read_little_endian<BiasType>(stream);
+      for (IndexType i = 0; i < OutputDimensions * PaddedInputDimensions; ++i)
+        weights[get_weight_index(i)] = read_little_endian<WeightType>(stream);
+
+      return !stream.fail();
+    }
+
+    // Write network parameters
+    bool write_parameters(std::ostream& stream) const {
+      for (IndexType i = 0; i < OutputDimensions; ++i)
+        write_little_endian<BiasType>(stream, biases[i]);
+
+      for (IndexType i = 0; i < OutputDimensions * PaddedInputDimensions; ++i)
+        write_little_endian<WeightType>(stream, weights[get_weight_index(i)]);
+
+      return !stream.fail();
+    }
+
+    // Forward propagation
+    const OutputType* propagate(
+        const InputType* input, OutputType* output) const {
+
+#if defined (USE_AVX512)
+      using vec_t = __m512i;
+      #define vec_set_32 _mm512_set1_epi32
+      #define vec_add_dpbusd_32 Simd::m512_add_dpbusd_epi32
+      #define vec_add_dpbusd_32x2 Simd::m512_add_dpbusd_epi32x2
+#elif defined (USE_AVX2)
+      using vec_t = __m256i;
+      #define vec_set_32 _mm256_set1_epi32
+      #define vec_add_dpbusd_32 Simd::m256_add_dpbusd_epi32
+      #define vec_add_dpbusd_32x2 Simd::m256_add_dpbusd_epi32x2
+#elif defined (USE_SSSE3)
+      using vec_t = __m128i;
+      #define vec_set_32 _mm_set1_epi32
+      #define vec_add_dpbusd_32 Simd::m128_add_dpbusd_epi32
+      #define vec_add_dpbusd_32x2 Simd::m128_add_dpbusd_epi32x2
+#endif
+
+#if defined (USE_SSSE3)
+      constexpr IndexType OutputSimdWidth = sizeof(vec_t) / sizeof(OutputType);
+      constexpr IndexType NumChunks = PaddedInputDimensions / ChunkSize;
+      constexpr IndexType NumRegs = OutputDimensions / OutputSimdWidth;
+
+      static_assert(OutputDimensions % OutputSimdWidth == 0, "Outputs must fill whole registers");
+
+      const auto input32 = reinterpret_cast<const std::int32_t*>(input);
+      std::uint16_t nnz[NumChunks];
+      const IndexType count = find_nnz<NumChunks>(input32, nnz);
+
+      const vec_t* biasvec = reinterpret_cast<const vec_t*>(biases);
+      vec_t acc[NumRegs];
+      for (IndexType k = 0; k < NumRegs; ++k)
+        acc[k] = biasvec[k];
+
+      // Pair the chunks, as the dense layers do, to widen to int32 once per pair
+      IndexType j = 0;
+      for ( ; j + 1 < count; j += 2)
+      {
+        const IndexType i0 = nnz[j + 0];
+        const IndexType i1 = nnz[j + 1];
+        const vec_t in0 = vec_set_32(input32[i0]);
+        const vec_t in1 = vec_set_32(input32[i1]);
+        const auto col0 = reinterpret_cast<const vec_t*>(&weights[i0 * OutputDimensions * ChunkSize]);
+        const auto col1 = reinterpret_cast<const vec_t*>(&weights[i1 * OutputDimensions * ChunkSize]);
+        for (IndexType k = 0; k < NumRegs; ++k)
+          vec_add_dpbusd_32x2(acc[k], in0, col0[k], in1, col1[k]);
+      }
+
+      if (j < count)
+      {
+        const IndexType i = nnz[j];
+        const vec_t in = vec_set_32(input32[i]);
+        const auto col = reinterpret_cast<const vec_t*>(&weights[i * OutputDimensions * ChunkSize]);
+        for (IndexType k = 0; k < NumRegs; ++k)
+          vec_add_dpbusd_32(acc[k], in, col[k]);
+      }
+
+      vec_t* outptr = reinterpret_cast<vec_t*>(output);
+      for (IndexType k = 0; k < NumRegs; ++k)
+        outptr[k] = acc[k];
+
+# undef vec_set_32
+# undef vec_add_dpbusd_32
+# undef vec_add_dpbusd_32x2
+#else
+      // Use old implementation for the other architectures.
+      affine_transform_non_ssse3<
+        InputDimensions,
+        PaddedInputDimensions,
+        OutputDimensions>(output, weights, biases, input);
+#endif
+
+      return output;
+    }
+
+   private:
+    using BiasType = OutputType;
+    using WeightType = std::int8_t;
+
+    alignas(CacheLineSize) BiasType biases[OutputDimensions];
+    alignas(CacheLineSize) WeightType weights[OutputDimensions * PaddedInputDimensions];
+  };
+
+NNUE_ARCH_END
+}  // namespace Stockfish::Eval::NNUE::Layers
+
+#endif // #ifndef NNUE_LAYERS_AFFINE_TRANSFORM_SPARSE_INPUT_H_INCLUDED
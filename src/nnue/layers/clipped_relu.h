@@ -24,6 +24,7 @@
 #include "../nnue_common.h"
 
 namespace Stockfish::Eval::NNUE::Layers {
+NNUE_ARCH_BEGIN
 
   // Clipped ReLU
   template <IndexType InDims>
@@ -175,6 +176,7 @@ namespace Stockfish::Eval::NNUE::Layers {
     }
   };
 
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE::Layers
 
 #endif // NNUE_LAYERS_CLIPPED_RELU_H_INCLUDED
@@ -24,6 +24,7 @@
 #include "../nnue_common.h"
 
 namespace Stockfish::Eval::NNUE::Layers {
+NNUE_ARCH_BEGIN
 
   // Clipped ReLU
   template <IndexType InDims>
@@ -115,6 +116,7 @@ namespace Stockfish::Eval::NNUE::Layers {
     }
   };
 
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE::Layers
 
 #endif // NNUE_LAYERS_SQR_CLIPPED_RELU_H_INCLUDED
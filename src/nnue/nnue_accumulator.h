@@ -21,6 +21,9 @@
 #ifndef NNUE_ACCUMULATOR_H_INCLUDED
 #define NNUE_ACCUMULATOR_H_INCLUDED
 
+#include <algorithm>
+#include <vector>
+
 #include "nnue_architecture.h"
 
 namespace Stockfish::Eval::NNUE {
@@ -32,6 +35,89 @@ namespace Stockfish::Eval::NNUE {
     bool computed[2];
   };
 
+  // AccumulatorCache, also known as a "Finny table", holds for each king square
+  // and perspective the accumulator of the last position refreshed with the king
+  // there, and the pieces of that position. A refresh then starts from it and
+  // only updates the pieces that differ, instead of adding all of them to the
+  // biases. Each thread has its own, emptied when another network is loaded.
+  struct AccumulatorCache {
+
+    struct alignas(CacheLineSize) Entry {
+      std::int16_t accumulation[TransformedFeatureDimensions];
+      std::int32_t psqtAccumulation[PSQTBuckets];
+      Bitboard byColorBB[COLOR_NB];
+      Bitboard byTypeBB[PIECE_TYPE_NB];
+    };
+
+    Entry entries[SQUARE_NB][COLOR_NB];
+    std::uint32_t netId = 0; // Network the entries belong to, 0 if none
+  };
+
+  // EvalCache is a small per-thread table of the raw network outputs of the
+  // positions last evaluated, sized by the EvalCache option. A position reached
+  // again, through another move order or after its TT entry was overwritten,
+  // then skips the accumulator update and the layers. It is direct mapped, an
+  // entry for another position is simply overwritten. Disabled (the default)
+  // it has no entries and probe() always misses.
+  class EvalCache {
+
+  public:
+    struct Entry {
+      Key key;
+      std::int32_t psqt, positional;
+    };
+
+    // Set the size of the table in kilobytes, 0 disables it. The table is
+    // emptied and its counters reset in any case.
+    void resize(std::size_t kbSize) {
+
+      const std::size_t count = kbSize * 1024 / sizeof(Entry);
+
+      if (count != entries.size())
+          entries = std::vector<Entry>(count);
+
+      clear();
+    }
+
+    void clear() {
+
+      std::fill(entries.begin(), entries.end(), Entry());
+      probes = hits = 0;
+    }
+
+    Entry* probe(Key key, bool& found) {
+
+      if (entries.empty())
+          return found = false, nullptr;
+
+      Entry* e = &entries[mul_hi64(key, entries.size())];
+
+      found = e->key == key;
+      ++probes;
+      hits += found;
+      return e;
+    }
+
+    std::uint64_t probes, hits;
+    std::uint32_t netId = 0; // Network the entries belong to, 0 if none
+
+  private:
+    std::vector<Entry> entries;
+  };
+
+  // AccumulatorStats counts the accumulator work of a thread. Accumulators are
+  // brought up to date only when a position is evaluated, each perspective in
+  // one pass over all the plies pending since the last computed one, storing
+  // only the first and the last of them. The plies in between, and the ones
+  // never evaluated, cost nothing but the flag cleared by do_move().
+  struct AccumulatorStats {
+    std::uint64_t evaluations;  // Calls to FeatureTransformer::transform()
+    std::uint64_t updates;      // Incremental passes, per perspective
+    std::uint64_t pliesUpdated; // Plies covered by these passes
+    std::uint64_t stores;       // Accumulators they computed
+    std::uint64_t refreshes;    // Refreshes from the AccumulatorCache
+  };
+
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // NNUE_ACCUMULATOR_H_INCLUDED
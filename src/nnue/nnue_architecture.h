@@ -28,12 +28,14 @@
 #include "features/half_ka_v2_hm.h"
 
 #include "layers/affine_transform.h"
+#include "layers/affine_transform_sparse_input.h"
 #include "layers/clipped_relu.h"
 #include "layers/sqr_clipped_relu.h"
 
 #include "../misc.h"
 
 namespace Stockfish::Eval::NNUE {
+NNUE_ARCH_BEGIN
 
 // Input features used in evaluation function
 using FeatureSet = Features::HalfKAv2_hm;
@@ -48,7 +50,7 @@ struct Network
   static constexpr int FC_0_OUTPUTS = 15;
   static constexpr int FC_1_OUTPUTS = 32;
 
-  Layers::AffineTransform<TransformedFeatureDimensions, FC_0_OUTPUTS + 1> fc_0;
+  Layers::AffineTransformSparseInput<TransformedFeatureDimensions, FC_0_OUTPUTS + 1> fc_0;
   Layers::SqrClippedReLU<FC_0_OUTPUTS + 1> ac_sqr_0;
   Layers::ClippedReLU<FC_0_OUTPUTS + 1> ac_0;
   Layers::AffineTransform<FC_0_OUTPUTS * 2, FC_1_OUTPUTS> fc_1;
@@ -90,23 +92,27 @@ struct Network
     return true;
   }
 
-  std::int32_t propagate(const TransformedFeatureType* transformedFeatures)
+  // Outputs of the layers for one input
+  struct alignas(CacheLineSize) Buffer
   {
-    struct alignas(CacheLineSize) Buffer
+    alignas(CacheLineSize) decltype(fc_0)::OutputBuffer fc_0_out;
+    alignas(CacheLineSize) decltype(ac_sqr_0)::OutputType ac_sqr_0_out[ceil_to_multiple<IndexType>(FC_0_OUTPUTS * 2, 32)];
+    alignas(CacheLineSize) decltype(ac_0)::OutputBuffer ac_0_out;
+    alignas(CacheLineSize) decltype(fc_1)::OutputBuffer fc_1_out;
+    alignas(CacheLineSize) decltype(ac_1)::OutputBuffer ac_1_out;
+    alignas(CacheLineSize) decltype(fc_2)::OutputBuffer fc_2_out;
+
+    Buffer()
     {
-      alignas(CacheLineSize) decltype(fc_0)::OutputBuffer fc_0_out;
-      alignas(CacheLineSize) decltype(ac_sqr_0)::OutputType ac_sqr_0_out[ceil_to_multiple<IndexType>(FC_0_OUTPUTS * 2, 32)];
-      alignas(CacheLineSize) decltype(ac_0)::OutputBuffer ac_0_out;
-      alignas(CacheLineSize) decltype(fc_1)::OutputBuffer fc_1_out;
-      alignas(CacheLineSize) decltype(ac_1)::OutputBuffer ac_1_out;
-      alignas(CacheLineSize) decltype(fc_2)::OutputBuffer fc_2_out;
-
-      Buffer()
-      {
-          std::memset(this, 0, sizeof(*this));
-      }
-    };
+        std::memset(this, 0, sizeof(*this));
+    }
+  };
 
+  // Number of inputs propagated together by the batched propagate()
+  static constexpr std::size_t MaxBatchSize = 32;
+
+  std::int32_t propagate(const TransformedFeatureType* transformedFeatures) const
+  {
 #if defined(__clang__) && (__APPLE__)
     // workaround for a bug reported with xcode 12
     static thread_local auto tlsBuffer = std::make_unique<Buffer>();
@@ -116,23 +122,65 @@ struct Network
     alignas(CacheLineSize) static thread_local Buffer buffer;
 #endif
 
-    fc_0.propagate(transformedFeatures, buffer.fc_0_out);
-    ac_sqr_0.propagate(buffer.fc_0_out, buffer.ac_sqr_0_out);
-    ac_0.propagate(buffer.fc_0_out, buffer.ac_0_out);
-    std::memcpy(buffer.ac_sqr_0_out + FC_0_OUTPUTS, buffer.ac_0_out, FC_0_OUTPUTS * sizeof(decltype(ac_0)::OutputType));
-    fc_1.propagate(buffer.ac_sqr_0_out, buffer.fc_1_out);
-    ac_1.propagate(buffer.fc_1_out, buffer.ac_1_out);
-    fc_2.propagate(buffer.ac_1_out, buffer.fc_2_out);
+    const TransformedFeatureType* input[] = { transformedFeatures };
+    std::int32_t output;
+    propagate(input, 1, &buffer, &output);
+    return output;
+  }
+
+  // Batched forward propagation of up to MaxBatchSize inputs. It runs one layer
+  // on all the inputs before the next layer, so the weights of each layer are
+  // loaded once for the batch rather than once per input.
+  void propagate(const TransformedFeatureType* const* transformedFeatures, std::size_t count,
+                 std::int32_t* output) const
+  {
+    assert(count <= MaxBatchSize);
+
+#if defined(__clang__) && (__APPLE__)
+    static thread_local auto tlsBuffers = std::make_unique<Buffer[]>(MaxBatchSize);
+    Buffer* buffers = tlsBuffers.get();
+#else
+    alignas(CacheLineSize) static thread_local Buffer buffers[MaxBatchSize];
+#endif
+
+    propagate(transformedFeatures, count, buffers, output);
+  }
 
-    // buffer.fc_0_out[FC_0_OUTPUTS] is such that 1.0 is equal to 127*(1<<WeightScaleBits) in quantized form
-    // but we want 1.0 to be equal to 600*OutputScale
-    std::int32_t fwdOut = int(buffer.fc_0_out[FC_0_OUTPUTS]) * (600*OutputScale) / (127*(1<<WeightScaleBits));
-    std::int32_t outputValue = buffer.fc_2_out[0] + fwdOut;
+ private:
+  void propagate(const TransformedFeatureType* const* transformedFeatures, std::size_t count,
+                 Buffer* buffers, std::int32_t* output) const
+  {
+    for (std::size_t i = 0; i < count; ++i)
+        fc_0.propagate(transformedFeatures[i], buffers[i].fc_0_out);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Buffer& buffer = buffers[i];
+        ac_sqr_0.propagate(buffer.fc_0_out, buffer.ac_sqr_0_out);
+        ac_0.propagate(buffer.fc_0_out, buffer.ac_0_out);
+        std::memcpy(buffer.ac_sqr_0_out + FC_0_OUTPUTS, buffer.ac_0_out, FC_0_OUTPUTS * sizeof(decltype(ac_0)::OutputType));
+    }
 
-    return outputValue;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        fc_1.propagate(buffers[i].ac_sqr_0_out, buffers[i].fc_1_out);
+        ac_1.propagate(buffers[i].fc_1_out, buffers[i].ac_1_out);
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+        fc_2.propagate(buffers[i].ac_1_out, buffers[i].fc_2_out);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        // buffer.fc_0_out[FC_0_OUTPUTS] is such that 1.0 is equal to 127*(1<<WeightScaleBits) in quantized form
+        // but we want 1.0 to be equal to 600*OutputScale
+        std::int32_t fwdOut = int(buffers[i].fc_0_out[FC_0_OUTPUTS]) * (600*OutputScale) / (127*(1<<WeightScaleBits));
+        output[i] = buffers[i].fc_2_out[0] + fwdOut;
+    }
   }
 };
 
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // #ifndef NNUE_ARCHITECTURE_H_INCLUDED
@@ -46,6 +46,7 @@
 #endif
 
 namespace Stockfish::Eval::NNUE {
+NNUE_ARCH_BEGIN
 
   // Version of the evaluation file
   constexpr std::uint32_t Version = 0x7AF32F20u;
@@ -159,6 +160,7 @@ namespace Stockfish::Eval::NNUE {
               write_little_endian<IntType>(stream, values[i]);
   }
 
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // #ifndef NNUE_COMMON_H_INCLUDED
@@ -0,0 +1,131 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2022 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runtime selection of the NNUE code, only built with ARCH=x86-64-dispatch.
+// The Makefile compiles evaluate_nnue.cpp and the feature set once per
+// instruction set below, each copy in the inline namespace NNUE_ARCH, and the
+// functions of evaluate.h forward to the copy picked here from cpuid.
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "../evaluate.h"
+#include "../misc.h"
+
+namespace Stockfish::Eval::NNUE {
+
+  // Must match NNUE_ARCHS in the Makefile
+  namespace sse41   { extern const Arch arch; }
+  namespace avx2    { extern const Arch arch; }
+  namespace avx512  { extern const Arch arch; }
+  namespace vnni512 { extern const Arch arch; }
+
+namespace {
+
+  // select_arch() returns the widest copy the CPU can run. The rest of the
+  // engine is compiled for SSE4.1 and POPCNT, so those are required.
+  const Arch& select_arch() {
+
+    const CpuInfo& cpu = cpu_info();
+
+    if (!cpu.sse41 || !cpu.popcnt)
+    {
+        std::cerr << "This build needs a CPU with SSE4.1 and POPCNT, use ARCH=x86-64 instead" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return cpu.vnni512 ? vnni512::arch
+         : cpu.avx512  ? avx512::arch
+         : cpu.avx2    ? avx2::arch
+                       : sse41::arch;
+  }
+
+  const Arch& Selected = select_arch();
+
+} // namespace
+
+  const char* arch_name() { return Selected.name; }
+
+  std::string trace(Position& pos) { return Selected.trace(pos); }
+
+  void benchmark(const Position& pos, int iterations, BenchmarkStats& stats) {
+    Selected.benchmark(pos, iterations, stats);
+  }
+
+  // benchmark_layers() times the kernels of each copy of the code the CPU can
+  // run. The other copies than the one in use get the network through a memory
+  // stream, as each keeps the weights in its own layout, and free it after.
+  std::vector<LayerBenchmark> benchmark_layers(const std::vector<std::string>& fens, int iterations) {
+
+    const CpuInfo& cpu = cpu_info();
+    const std::pair<const Arch*, bool> archs[] = {
+      { &sse41::arch, true }, { &avx2::arch, cpu.avx2 }, { &avx512::arch, cpu.avx512 }, { &vnni512::arch, cpu.vnni512 }
+    };
+
+    std::vector<LayerBenchmark> results;
+
+    for (const auto& [arch, supported] : archs)
+    {
+        if (!supported)
+            continue;
+
+        LayerBenchmark result{ arch->name, {} };
+
+        if (arch == &Selected)
+            arch->benchmark_layers(fens, iterations, result.layers);
+        else
+        {
+            std::stringstream stream;
+            if (Selected.save_eval(stream) && arch->load_eval(currentEvalFileName, stream))
+                arch->benchmark_layers(fens, iterations, result.layers);
+            arch->release();
+        }
+
+        if (!result.layers.empty())
+            results.push_back(result);
+    }
+
+    return results;
+  }
+
+  Value evaluate(const Position& pos, bool adjusted, int* complexity) {
+    return Selected.evaluate(pos, adjusted, complexity);
+  }
+
+  void evaluate(const Position* const* positions, std::size_t count, Value* values) {
+    Selected.evaluate_batch(positions, count, values);
+  }
+
+  bool load_eval(std::string name, std::istream& stream) {
+    return Selected.load_eval(name, stream);
+  }
+
+  bool load_image(std::string name, const std::string& path) {
+    return Selected.load_image(name, path);
+  }
+
+  bool save_image(const std::string& filename) { return Selected.save_image(filename); }
+
+  bool save_eval(std::ostream& stream) { return Selected.save_eval(stream); }
+
+  bool save_eval(const std::optional<std::string>& filename) {
+    return Selected.save_eval_file(filename);
+  }
+
+} // namespace Stockfish::Eval::NNUE
@@ -27,6 +27,7 @@
 #include <cstring> // std::memset()
 
 namespace Stockfish::Eval::NNUE {
+NNUE_ARCH_BEGIN
 
   using BiasType       = std::int16_t;
   using WeightType     = std::int16_t;
@@ -269,14 +270,39 @@ namespace Stockfish::Eval::NNUE {
       return !stream.fail();
     }
 
+    // Empty an accumulator cache entry, it is then the accumulator of a board
+    // without any piece
+    void clear(AccumulatorCache::Entry& entry) const {
+
+      std::memcpy(entry.accumulation, biases, sizeof(biases));
+      std::memset(entry.psqtAccumulation, 0, sizeof(entry.psqtAccumulation));
+      std::memset(entry.byColorBB, 0, sizeof(entry.byColorBB));
+      std::memset(entry.byTypeBB, 0, sizeof(entry.byTypeBB));
+    }
+
+    // Empty all the entries of an accumulator cache
+    void clear(AccumulatorCache& cache) const {
+
+      for (auto& entries : cache.entries)
+          for (auto& entry : entries)
+              clear(entry);
+    }
+
+    // Bring the accumulators of both perspectives of the position up to date
+    void update_accumulators(const Position& pos, AccumulatorCache& cache, AccumulatorStats& stats) const {
+      update_accumulator(pos, WHITE, cache, stats);
+      update_accumulator(pos, BLACK, cache, stats);
+    }
+
     // Convert input features
-    std::int32_t transform(const Position& pos, OutputType* output, int bucket) const {
-      update_accumulator(pos, WHITE);
-      update_accumulator(pos, BLACK);
+    std::int32_t transform(const Position& pos, AccumulatorCache& cache, AccumulatorStats& stats,
+                           OutputType* output, int bucket) const {
+      ++stats.evaluations;
+      update_accumulators(pos, cache, stats);
 
       const Color perspectives[2] = {pos.side_to_move(), ~pos.side_to_move()};
-      const auto& accumulation = pos.state()->accumulator.accumulation;
-      const auto& psqtAccumulation = pos.state()->accumulator.psqtAccumulation;
+      const auto& accumulation = pos.state()->accumulator->accumulation;
+      const auto& psqtAccumulation = pos.state()->accumulator->psqtAccumulation;
 
       const auto psqt = (
             psqtAccumulation[perspectives[0]][bucket]
@@ -338,7 +364,8 @@ namespace Stockfish::Eval::NNUE {
 
 
    private:
-    void update_accumulator(const Position& pos, const Color perspective) const {
+    void update_accumulator(const Position& pos, const Color perspective,
+                            AccumulatorCache& cache, AccumulatorStats& stats) const {
 
       // The size must be enough to contain the largest possible update.
       // That might depend on the feature set and generally relies on the
@@ -352,11 +379,18 @@ namespace Stockfish::Eval::NNUE {
       psqt_vec_t psqt[NumPsqtRegs];
   #endif
 
+      assert(pos.state()->accumulator);
+
+      if (pos.state()->accumulator->computed[perspective])
+        return;
+
       // Look for a usable accumulator of an earlier position. We keep track
       // of the estimated gain in terms of features to be added/subtracted.
+      // The states before the root of the search have no accumulator.
       StateInfo *st = pos.state(), *next = nullptr;
       int gain = FeatureSet::refresh_cost(pos);
-      while (st->previous && !st->accumulator.computed[perspective])
+      int plies = 0;
+      while (st->previous && st->previous->accumulator && !st->accumulator->computed[perspective])
       {
         // This governs when a full feature refresh is needed and how many
         // updates are better than just one full refresh.
@@ -365,12 +399,16 @@ namespace Stockfish::Eval::NNUE {
           break;
         next = st;
         st = st->previous;
+        ++plies;
       }
 
-      if (st->accumulator.computed[perspective])
+      if (st->accumulator->computed[perspective])
       {
-        if (next == nullptr)
-          return;
+        assert(next);
+
+        ++stats.updates;
+        stats.pliesUpdated += plies;
+        stats.stores += 1 + (next != pos.state());
 
         // Update incrementally in two steps. First, we update the "next"
         // accumulator. Then, we update the current accumulator (pos.state()).
@@ -385,8 +423,8 @@ namespace Stockfish::Eval::NNUE {
             ksq, st2->dirtyPiece, perspective, removed[1], added[1]);
 
         // Mark the accumulators as computed.
-        next->accumulator.computed[perspective] = true;
-        pos.state()->accumulator.computed[perspective] = true;
+        next->accumulator->computed[perspective] = true;
+        pos.state()->accumulator->computed[perspective] = true;
 
         // Now update the accumulators listed in states_to_update[], where the last element is a sentinel.
         StateInfo *states_to_update[3] =
@@ -396,7 +434,7 @@ namespace Stockfish::Eval::NNUE {
         {
           // Load accumulator
           auto accTile = reinterpret_cast<vec_t*>(
-            &st->accumulator.accumulation[perspective][j * TileHeight]);
+            &st->accumulator->accumulation[perspective][j * TileHeight]);
           for (IndexType k = 0; k < NumRegs; ++k)
             acc[k] = vec_load(&accTile[k]);
 
@@ -422,7 +460,7 @@ namespace Stockfish::Eval::NNUE {
 
             // Store accumulator
             accTile = reinterpret_cast<vec_t*>(
-              &states_to_update[i]->accumulator.accumulation[perspective][j * TileHeight]);
+              &states_to_update[i]->accumulator->accumulation[perspective][j * TileHeight]);
             for (IndexType k = 0; k < NumRegs; ++k)
               vec_store(&accTile[k], acc[k]);
           }
@@ -432,7 +470,7 @@ namespace Stockfish::Eval::NNUE {
         {
           // Load accumulator
           auto accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-            &st->accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
+            &st->accumulator->psqtAccumulation[perspective][j * PsqtTileHeight]);
           for (std::size_t k = 0; k < NumPsqtRegs; ++k)
             psqt[k] = vec_load_psqt(&accTilePsqt[k]);
 
@@ -458,7 +496,7 @@ namespace Stockfish::Eval::NNUE {
 
             // Store accumulator
             accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-              &states_to_update[i]->accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
+              &states_to_update[i]->accumulator->psqtAccumulation[perspective][j * PsqtTileHeight]);
             for (std::size_t k = 0; k < NumPsqtRegs; ++k)
               vec_store_psqt(&accTilePsqt[k], psqt[k]);
           }
@@ -467,12 +505,12 @@ namespace Stockfish::Eval::NNUE {
   #else
         for (IndexType i = 0; states_to_update[i]; ++i)
         {
-          std::memcpy(states_to_update[i]->accumulator.accumulation[perspective],
-              st->accumulator.accumulation[perspective],
+          std::memcpy(states_to_update[i]->accumulator->accumulation[perspective],
+              st->accumulator->accumulation[perspective],
               HalfDimensions * sizeof(BiasType));
 
           for (std::size_t k = 0; k < PSQTBuckets; ++k)
-            states_to_update[i]->accumulator.psqtAccumulation[perspective][k] = st->accumulator.psqtAccumulation[perspective][k];
+            states_to_update[i]->accumulator->psqtAccumulation[perspective][k] = st->accumulator->psqtAccumulation[perspective][k];
 
           st = states_to_update[i];
 
@@ -482,10 +520,10 @@ namespace Stockfish::Eval::NNUE {
             const IndexType offset = HalfDimensions * index;
 
             for (IndexType j = 0; j < HalfDimensions; ++j)
-              st->accumulator.accumulation[perspective][j] -= weights[offset + j];
+              st->accumulator->accumulation[perspective][j] -= weights[offset + j];
 
             for (std::size_t k = 0; k < PSQTBuckets; ++k)
-              st->accumulator.psqtAccumulation[perspective][k] -= psqtWeights[index * PSQTBuckets + k];
+              st->accumulator->psqtAccumulation[perspective][k] -= psqtWeights[index * PSQTBuckets + k];
           }
 
           // Difference calculation for the activated features
@@ -494,31 +532,65 @@ namespace Stockfish::Eval::NNUE {
             const IndexType offset = HalfDimensions * index;
 
             for (IndexType j = 0; j < HalfDimensions; ++j)
-              st->accumulator.accumulation[perspective][j] += weights[offset + j];
+              st->accumulator->accumulation[perspective][j] += weights[offset + j];
 
             for (std::size_t k = 0; k < PSQTBuckets; ++k)
-              st->accumulator.psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
+              st->accumulator->psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
           }
         }
   #endif
       }
       else
       {
-        // Refresh the accumulator
-        auto& accumulator = pos.state()->accumulator;
-        accumulator.computed[perspective] = true;
-        FeatureSet::IndexList active;
-        FeatureSet::append_active_indices(pos, perspective, active);
+        // Refresh the accumulator, starting from the cache entry of the king
+        // square and perspective: only the pieces that differ between the
+        // position of the entry and the current one need to be updated.
+        auto accumulator = pos.state()->accumulator;
+        accumulator->computed[perspective] = true;
+        ++stats.refreshes;
+
+        const Square ksq = pos.square<KING>(perspective);
+        auto& entry = cache.entries[ksq][perspective];
+        FeatureSet::IndexList removed, added;
+
+        for (Color c : { WHITE, BLACK })
+            for (PieceType pt = PAWN; pt <= KING; ++pt)
+            {
+                const Piece pc = make_piece(c, pt);
+                const Bitboard oldBB = entry.byColorBB[c] & entry.byTypeBB[pt];
+                const Bitboard newBB = pos.pieces(c, pt);
+                Bitboard toRemove = oldBB & ~newBB;
+                Bitboard toAdd    = newBB & ~oldBB;
+
+                while (toRemove)
+                    removed.push_back(FeatureSet::make_index(perspective, pop_lsb(toRemove), pc, ksq));
+                while (toAdd)
+                    added.push_back(FeatureSet::make_index(perspective, pop_lsb(toAdd), pc, ksq));
+            }
+
+        for (Color c : { WHITE, BLACK })
+            entry.byColorBB[c] = pos.pieces(c);
+        for (PieceType pt = PAWN; pt <= KING; ++pt)
+            entry.byTypeBB[pt] = pos.pieces(pt);
 
   #ifdef VECTOR
         for (IndexType j = 0; j < HalfDimensions / TileHeight; ++j)
         {
-          auto biasesTile = reinterpret_cast<const vec_t*>(
-              &biases[j * TileHeight]);
+          auto entryTile = reinterpret_cast<vec_t*>(
+              &entry.accumulation[j * TileHeight]);
           for (IndexType k = 0; k < NumRegs; ++k)
-            acc[k] = biasesTile[k];
+            acc[k] = vec_load(&entryTile[k]);
+
+          for (const auto index : removed)
+          {
+            const IndexType offset = HalfDimensions * index + j * TileHeight;
+            auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
+
+            for (unsigned k = 0; k < NumRegs; ++k)
+              acc[k] = vec_sub_16(acc[k], column[k]);
+          }
 
-          for (const auto index : active)
+          for (const auto index : added)
           {
             const IndexType offset = HalfDimensions * index + j * TileHeight;
             auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
@@ -528,17 +600,31 @@ namespace Stockfish::Eval::NNUE {
           }
 
           auto accTile = reinterpret_cast<vec_t*>(
-              &accumulator.accumulation[perspective][j * TileHeight]);
+              &accumulator->accumulation[perspective][j * TileHeight]);
           for (unsigned k = 0; k < NumRegs; k++)
+          {
+            vec_store(&entryTile[k], acc[k]);
             vec_store(&accTile[k], acc[k]);
+          }
         }
 
         for (IndexType j = 0; j < PSQTBuckets / PsqtTileHeight; ++j)
         {
+          auto entryTilePsqt = reinterpret_cast<psqt_vec_t*>(
+              &entry.psqtAccumulation[j * PsqtTileHeight]);
           for (std::size_t k = 0; k < NumPsqtRegs; ++k)
-            psqt[k] = vec_zero_psqt();
+            psqt[k] = vec_load_psqt(&entryTilePsqt[k]);
+
+          for (const auto index : removed)
+          {
+            const IndexType offset = PSQTBuckets * index + j * PsqtTileHeight;
+            auto columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
+
+            for (std::size_t k = 0; k < NumPsqtRegs; ++k)
+              psqt[k] = vec_sub_psqt_32(psqt[k], columnPsqt[k]);
+          }
 
-          for (const auto index : active)
+          for (const auto index : added)
           {
             const IndexType offset = PSQTBuckets * index + j * PsqtTileHeight;
             auto columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
@@ -548,28 +634,41 @@ namespace Stockfish::Eval::NNUE {
           }
 
           auto accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-            &accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
+            &accumulator->psqtAccumulation[perspective][j * PsqtTileHeight]);
           for (std::size_t k = 0; k < NumPsqtRegs; ++k)
+          {
+            vec_store_psqt(&entryTilePsqt[k], psqt[k]);
             vec_store_psqt(&accTilePsqt[k], psqt[k]);
+          }
         }
 
   #else
-        std::memcpy(accumulator.accumulation[perspective], biases,
-            HalfDimensions * sizeof(BiasType));
+        for (const auto index : removed)
+        {
+          const IndexType offset = HalfDimensions * index;
 
-        for (std::size_t k = 0; k < PSQTBuckets; ++k)
-          accumulator.psqtAccumulation[perspective][k] = 0;
+          for (IndexType j = 0; j < HalfDimensions; ++j)
+            entry.accumulation[j] -= weights[offset + j];
 
-        for (const auto index : active)
+          for (std::size_t k = 0; k < PSQTBuckets; ++k)
+            entry.psqtAccumulation[k] -= psqtWeights[index * PSQTBuckets + k];
+        }
+
+        for (const auto index : added)
         {
           const IndexType offset = HalfDimensions * index;
 
           for (IndexType j = 0; j < HalfDimensions; ++j)
-            accumulator.accumulation[perspective][j] += weights[offset + j];
+            entry.accumulation[j] += weights[offset + j];
 
           for (std::size_t k = 0; k < PSQTBuckets; ++k)
-            accumulator.psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
+            entry.psqtAccumulation[k] += psqtWeights[index * PSQTBuckets + k];
         }
+
+        std::memcpy(accumulator->accumulation[perspective], entry.accumulation,
+            HalfDimensions * sizeof(BiasType));
+        std::memcpy(accumulator->psqtAccumulation[perspective], entry.psqtAccumulation,
+            PSQTBuckets * sizeof(PSQTWeightType));
   #endif
       }
 
@@ -583,6 +682,7 @@ namespace Stockfish::Eval::NNUE {
     alignas(CacheLineSize) PSQTWeightType psqtWeights[InputDimensions * PSQTBuckets];
   };
 
+NNUE_ARCH_END
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // #ifndef NNUE_FEATURE_TRANSFORMER_H_INCLUDED
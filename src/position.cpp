@@ -79,7 +79,6 @@ std::ostream& operator<<(std::ostream& os, const Position& pos) {
       && !pos.can_castle(ANY_CASTLING))
   {
       StateInfo st;
-      ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
       Position p;
       p.set(pos.fen(), pos.is_chess960(), &st, pos.this_thread());
@@ -702,8 +701,9 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   ++st->pliesFromNull;
 
   // Used by NNUE
-  st->accumulator.computed[WHITE] = false;
-  st->accumulator.computed[BLACK] = false;
+  st->accumulator = st->previous->accumulator ? st->previous->accumulator + 1 : nullptr;
+  if (st->accumulator)
+      st->accumulator->computed[WHITE] = st->accumulator->computed[BLACK] = false;
   auto& dp = st->dirtyPiece;
   dp.dirty_num = 1;
 
@@ -1003,8 +1003,9 @@ void Position::do_null_move(StateInfo& newSt) {
 
   st->dirtyPiece.dirty_num = 0;
   st->dirtyPiece.piece[0] = NO_PIECE; // Avoid checks in UpdateAccumulator()
-  st->accumulator.computed[WHITE] = false;
-  st->accumulator.computed[BLACK] = false;
+  st->accumulator = st->previous->accumulator ? st->previous->accumulator + 1 : nullptr;
+  if (st->accumulator)
+      st->accumulator->computed[WHITE] = st->accumulator->computed[BLACK] = false;
 
   if (st->epSquare != SQ_NONE)
   {
@@ -1014,7 +1015,7 @@ void Position::do_null_move(StateInfo& newSt) {
 
   st->key ^= Zobrist::side;
   ++st->rule50;
-  prefetch(TT.first_entry(key()));
+  prefetch(thisThread->pool().tt->first_entry(key()));
 
   st->pliesFromNull = 0;
 
@@ -1319,7 +1320,6 @@ bool Position::pos_is_ok() const {
               assert(0 && "pos_is_ok: Bitboards");
 
   StateInfo si = *st;
-  ASSERT_ALIGNED(&si, Eval::NNUE::CacheLineSize);
 
   set_state(&si);
   if (std::memcmp(&si, st, sizeof(StateInfo)))
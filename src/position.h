@@ -58,8 +58,9 @@ struct StateInfo {
   Piece      capturedPiece;
   int        repetition;
 
-  // Used by NNUE
-  Eval::NNUE::Accumulator accumulator;
+  // Used by NNUE. The accumulator, if any, is on the stack of the searching
+  // thread, indexed by ply like the states of the search.
+  Eval::NNUE::Accumulator* accumulator;
   DirtyPiece dirtyPiece;
 };
 
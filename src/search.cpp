@@ -37,19 +37,6 @@
 
 namespace Stockfish {
 
-namespace Search {
-
-  LimitsType Limits;
-}
-
-namespace Tablebases {
-
-  int Cardinality;
-  bool RootInTB;
-  bool UseRule50;
-  Depth ProbeDepth;
-}
-
 namespace TB = Tablebases;
 
 using std::string;
@@ -102,7 +89,7 @@ namespace {
     }
     bool enabled() const { return level < 20.0; }
     bool time_to_pick(Depth depth) const { return depth == 1 + int(level); }
-    Move pick_best(size_t multiPV);
+    Move pick_best(const RootMoves& rootMoves, size_t multiPV);
 
     double level;
     Move best = MOVE_NONE;
@@ -122,31 +109,117 @@ namespace {
   void update_all_stats(const Position& pos, Stack* ss, Move bestMove, Value bestValue, Value beta, Square prevSq,
                         Move* quietsSearched, int quietCount, Move* capturesSearched, int captureCount, Depth depth);
 
+  // PerftTable is a lockless hash table of perft counts shared by the threads,
+  // indexed by position key and depth. Each entry keeps its key xored with its
+  // data, so that an entry torn by concurrent writes is seen as a miss.
+  class PerftTable {
+
+    struct Entry {
+      std::atomic<uint64_t> keyXorData, data; // Data is count << 8 | depth
+    };
+
+  public:
+    // resize() sets the size of the table in megabytes, 0 disables it. The
+    // counts kept do not depend on the search, so a table of the same size
+    // is kept from one perft to the next.
+    void resize(size_t mbSize) {
+
+      const size_t count = mbSize * 1024 * 1024 / sizeof(Entry);
+
+      if (count != entryCount)
+      {
+          table = std::vector<Entry>(count);
+          entryCount = count;
+      }
+    }
+
+    bool probe(Key key, Depth depth, uint64_t& cnt) const {
+
+      if (!entryCount)
+          return false;
+
+      const Entry& e = table[mul_hi64(key, entryCount)];
+      uint64_t data = e.data.load(std::memory_order_relaxed);
+
+      if (   (e.keyXorData.load(std::memory_order_relaxed) ^ data) != key
+          || Depth(data & 0xFF) != depth)
+          return false;
+
+      cnt = data >> 8;
+      return true;
+    }
+
+    void save(Key key, Depth depth, uint64_t cnt) {
+
+      if (!entryCount)
+          return;
+
+      Entry& e = table[mul_hi64(key, entryCount)];
+      uint64_t data = cnt << 8 | uint64_t(depth);
+
+      e.keyXorData.store(key ^ data, std::memory_order_relaxed);
+      e.data.store(data, std::memory_order_relaxed);
+    }
+
+  private:
+    std::vector<Entry> table;
+    size_t entryCount = 0;
+  };
+
+  PerftTable PerftTT;
+  std::atomic<size_t> perftNextMove; // Index of the next root move to count
+  std::vector<uint64_t> perftCounts; // Leaf nodes under each root move
+
   // perft() is our utility to verify move generation. All the leaf nodes up
-  // to the given depth are generated and counted, and the sum is returned.
-  template<bool Root>
+  // to the given depth, at least 2, are generated and counted, and the sum is
+  // returned. The last ply is bulk counted from the size of the move list.
   uint64_t perft(Position& pos, Depth depth) {
 
-    StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
+    uint64_t nodes = 0;
 
-    uint64_t cnt, nodes = 0;
+    if (PerftTT.probe(pos.key(), depth, nodes))
+        return nodes;
+
+    StateInfo st;
     const bool leaf = (depth == 2);
 
     for (const auto& m : MoveList<LEGAL>(pos))
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
+        pos.do_move(m, st);
+        nodes += leaf ? MoveList<LEGAL>(pos).size() : perft(pos, depth - 1);
+        pos.undo_move(m);
+    }
+
+    PerftTT.save(pos.key(), depth, nodes);
+    return nodes;
+  }
+
+  // perft_root() counts root moves of a perft, taking each time the next one
+  // not yet taken by another thread, until there is none left. The count of
+  // each is stored in perftCounts and the sum of them is returned.
+  uint64_t perft_root(Position& pos, Depth depth) {
+
+    StateInfo st;
+    uint64_t cnt, nodes = 0;
+    const MoveList<LEGAL> moves(pos);
+
+    for (size_t i; (i = perftNextMove++) < moves.size(); )
+    {
+        const Move m = moves.begin()[i];
+
+        if (depth <= 1)
+            cnt = 1;
         else
         {
             pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
+            cnt = depth == 2 ? MoveList<LEGAL>(pos).size() : perft(pos, depth - 1);
             pos.undo_move(m);
         }
-        if (Root)
-            sync_cout << UCI::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
+
+        perftCounts[i] = cnt;
+        nodes += cnt;
     }
+
     return nodes;
   }
 
@@ -168,7 +241,7 @@ void Search::clear() {
 
   Threads.main()->wait_for_search_finished();
 
-  Time.availableNodes = 0;
+  Threads.time.availableNodes = 0;
   TT.clear();
   Threads.clear();
   Tablebases::init(Options["SyzygyPath"]); // Free mapped files
@@ -180,29 +253,53 @@ void Search::clear() {
 
 void MainThread::search() {
 
-  if (Limits.perft)
+  ThreadPool& threads = pool();
+  Search::LimitsType& limits = threads.limits;
+
+  if (limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      const MoveList<LEGAL> moves(rootPos);
+
+      PerftTT.resize(size_t(Options["PerftHash"]));
+      perftCounts.assign(moves.size(), 0);
+      perftNextMove = 0;
+
+      threads.start_searching(); // start non-main threads
+      Thread::search();          // main thread counts its share of root moves
+      threads.wait_for_search_finished();
+
+      for (size_t i = 0; i < moves.size(); ++i)
+          sync_cout << UCI::move(moves.begin()[i], rootPos.is_chess960()) << ": " << perftCounts[i] << sync_endl;
+
+      const uint64_t total = threads.nodes_searched();
+      const TimePoint elapsed = now() - limits.startTime + 1; // Ensure positivity to avoid a 'divide by zero'
+
+      sync_cout << "\nNodes searched: " << total
+                << "\nNodes/second  : " << 1000 * total / elapsed << "\n" << sync_endl;
       return;
   }
 
   Color us = rootPos.side_to_move();
-  Time.init(Limits, us, rootPos.game_ply());
-  TT.new_search();
+  threads.time.init(limits, us, rootPos.game_ply());
+
+  if (!threads.quiet) // A quiet pool leaves it to its caller
+      threads.tt->new_search();
 
-  Eval::NNUE::verify();
+  if (&threads == &Threads) // The other pools verify the network up front
+      Eval::NNUE::verify();
 
   if (rootMoves.empty())
   {
       rootMoves.emplace_back(MOVE_NONE);
-      sync_cout << "info depth 0 score "
-                << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
-                << sync_endl;
+
+      if (!threads.quiet)
+          sync_cout << threads.prefix << "info depth 0 score "
+                    << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
+                    << sync_endl;
   }
   else
   {
-      Threads.start_searching(); // start non-main threads
+      threads.start_searching(); // start non-main threads
       Thread::search();          // main thread start searching
   }
 
@@ -212,41 +309,49 @@ void MainThread::search() {
   // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
   // until the GUI sends one of those commands.
 
-  while (!Threads.stop && (ponder || Limits.infinite))
+  while (!threads.stop && (ponder || limits.infinite))
   {} // Busy wait for a stop or a ponder reset
 
   // Stop the threads if not already stopped (also raise the stop if
   // "ponderhit" just reset Threads.ponder).
-  Threads.stop = true;
+  threads.stop = true;
 
   // Wait until all threads have finished
-  Threads.wait_for_search_finished();
+  threads.wait_for_search_finished();
 
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
-  if (Limits.npmsec)
-      Time.availableNodes += Limits.inc[us] - Threads.nodes_searched();
+  if (limits.npmsec)
+      threads.time.availableNodes += limits.inc[us] - threads.nodes_searched();
+
+  if (threads.perfCounters && !threads.quiet && rootMoves[0].pv[0] != MOVE_NONE)
+      sync_cout << threads.prefix << "info string " << threads.perf_stats(true, threads.nodes_searched()) << sync_endl;
 
   Thread* bestThread = this;
   Skill skill = Skill(Options["Skill Level"], Options["UCI_LimitStrength"] ? int(Options["UCI_Elo"]) : 0);
 
   if (   int(Options["MultiPV"]) == 1
-      && !Limits.depth
+      && !limits.depth
       && !skill.enabled()
       && rootMoves[0].pv[0] != MOVE_NONE)
-      bestThread = Threads.get_best_thread();
+      bestThread = threads.get_best_thread();
 
   bestPreviousScore = bestThread->rootMoves[0].score;
   bestPreviousAverageScore = bestThread->rootMoves[0].averageScore;
 
-  for (Thread* th : Threads)
+  for (Thread* th : threads)
     th->previousDepth = bestThread->completedDepth;
 
+  threads.lastBestThread = bestThread;
+
+  if (threads.quiet)
+      return;
+
   // Send again PV info if we have a new best thread
   if (bestThread != this)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
 
-  sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
+  sync_cout << threads.prefix << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
 
   if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
       std::cout << " ponder " << UCI::move(bestThread->rootMoves[0].pv[1], rootPos.is_chess960());
@@ -261,6 +366,15 @@ void MainThread::search() {
 
 void Thread::search() {
 
+  ThreadPool& threads = owner;
+  const Search::LimitsType& limits = threads.limits;
+
+  if (limits.perft)
+  {
+      nodes = perft_root(rootPos, limits.perft);
+      return;
+  }
+
   // To allow access to (ss-7) up to (ss+2), the stack must be oversized.
   // The former is needed to allow update_continuation_histories(ss-1, ...),
   // which accesses its argument at ss-6, also near the root.
@@ -270,7 +384,7 @@ void Thread::search() {
   Value alpha, beta, delta;
   Move  lastBestMove = MOVE_NONE;
   Depth lastBestMoveDepth = 0;
-  MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
+  MainThread* mainThread = (this == threads.main() ? threads.main() : nullptr);
   double timeReduction = 1, totBestMoveChanges = 0;
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
@@ -284,6 +398,13 @@ void Thread::search() {
 
   ss->pv = pv;
 
+  if (threads.perfCounters)
+  {
+      if (!perf.is_open())
+          perf.open();
+      perf.start();
+  }
+
   bestValue = delta = alpha = -VALUE_INFINITE;
   beta = VALUE_INFINITE;
 
@@ -317,8 +438,8 @@ void Thread::search() {
 
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
-         && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !threads.stop
+         && !(limits.depth && mainThread && rootDepth > limits.depth))
   {
       // Age out PV variability metric
       if (mainThread)
@@ -332,11 +453,11 @@ void Thread::search() {
       size_t pvFirst = 0;
       pvLast = 0;
 
-      if (!Threads.increaseDepth)
+      if (!threads.increaseDepth)
          searchAgainCounter++;
 
       // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      for (pvIdx = 0; pvIdx < multiPV && !threads.stop; ++pvIdx)
       {
           if (pvIdx == pvLast)
           {
@@ -387,15 +508,16 @@ void Thread::search() {
               // If search has been stopped, we break immediately. Sorting is
               // safe because RootMoves is still valid, although it refers to
               // the previous iteration.
-              if (Threads.stop)
+              if (threads.stop)
                   break;
 
               // When failing high/low give some update (without cluttering
               // the UI) before a re-search.
               if (   mainThread
+                  && !threads.quiet
                   && multiPV == 1
                   && (bestValue <= alpha || bestValue >= beta)
-                  && Time.elapsed() > 3000)
+                  && threads.time.elapsed() > 3000)
                   sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
 
               // In case of failing low/high increase aspiration window and
@@ -426,41 +548,47 @@ void Thread::search() {
           std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
           if (    mainThread
-              && (Threads.stop || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
+              && !threads.quiet
+              && (threads.stop || pvIdx + 1 == multiPV || threads.time.elapsed() > 3000))
               sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
       }
 
-      if (!Threads.stop)
+      if (!threads.stop)
+      {
           completedDepth = rootDepth;
 
+          if (mainThread)
+              mainThread->depthTime[rootDepth] = threads.time.elapsed();
+      }
+
       if (rootMoves[0].pv[0] != lastBestMove) {
          lastBestMove = rootMoves[0].pv[0];
          lastBestMoveDepth = rootDepth;
       }
 
       // Have we found a "mate in x"?
-      if (   Limits.mate
+      if (   limits.mate
           && bestValue >= VALUE_MATE_IN_MAX_PLY
-          && VALUE_MATE - bestValue <= 2 * Limits.mate)
-          Threads.stop = true;
+          && VALUE_MATE - bestValue <= 2 * limits.mate)
+          threads.stop = true;
 
       if (!mainThread)
           continue;
 
       // If skill level is enabled and time is up, pick a sub-optimal best move
       if (skill.enabled() && skill.time_to_pick(rootDepth))
-          skill.pick_best(multiPV);
+          skill.pick_best(rootMoves, multiPV);
 
       // Use part of the gained time from a previous stable move for the current move
-      for (Thread* th : Threads)
+      for (Thread* th : threads)
       {
           totBestMoveChanges += th->bestMoveChanges;
           th->bestMoveChanges = 0;
       }
 
       // Do we have time for the next iteration? Can we stop searching now?
-      if (    Limits.use_time_management()
-          && !Threads.stop
+      if (    limits.use_time_management()
+          && !threads.stop
           && !mainThread->stopOnPonderhit)
       {
           double fallingEval = (69 + 12 * (mainThread->bestPreviousAverageScore - bestValue)
@@ -470,11 +598,11 @@ void Thread::search() {
           // If the bestMove is stable over several iterations, reduce time accordingly
           timeReduction = lastBestMoveDepth + 10 < completedDepth ? 1.63 : 0.73;
           double reduction = (1.56 + mainThread->previousTimeReduction) / (2.20 * timeReduction);
-          double bestMoveInstability = 1 + 1.7 * totBestMoveChanges / Threads.size();
+          double bestMoveInstability = 1 + 1.7 * totBestMoveChanges / threads.size();
           int complexity = mainThread->complexityAverage.value();
           double complexPosition = std::clamp(1.0 + (complexity - 277) / 1819, 0.5, 1.5);
 
-          double totalTime = Time.optimum() * fallingEval * reduction * bestMoveInstability * complexPosition;
+          double totalTime = threads.time.optimum() * fallingEval * reduction * bestMoveInstability * complexPosition;
 
           // Cap used time in case of a single legal move for a better viewer experience in tournaments
           // yielding correct scores and sufficiently fast moves.
@@ -482,27 +610,30 @@ void Thread::search() {
               totalTime = std::min(500.0, totalTime);
 
           // Stop the search if we have exceeded the totalTime
-          if (Time.elapsed() > totalTime)
+          if (threads.time.elapsed() > totalTime)
           {
               // If we are allowed to ponder do not stop the search now but
               // keep pondering until the GUI sends "ponderhit" or "stop".
               if (mainThread->ponder)
                   mainThread->stopOnPonderhit = true;
               else
-                  Threads.stop = true;
+                  threads.stop = true;
           }
-          else if (   Threads.increaseDepth
+          else if (   threads.increaseDepth
                    && !mainThread->ponder
-                   && Time.elapsed() > totalTime * 0.43)
-                   Threads.increaseDepth = false;
+                   && threads.time.elapsed() > totalTime * 0.43)
+                   threads.increaseDepth = false;
           else
-                   Threads.increaseDepth = true;
+                   threads.increaseDepth = true;
       }
 
       mainThread->iterValue[iterIdx] = bestValue;
       iterIdx = (iterIdx + 1) & 3;
   }
 
+  if (threads.perfCounters)
+      perf.stop();
+
   if (!mainThread)
       return;
 
@@ -511,7 +642,7 @@ void Thread::search() {
   // If skill level is enabled, swap best PV line with the sub-optimal one
   if (skill.enabled())
       std::swap(rootMoves[0], *std::find(rootMoves.begin(), rootMoves.end(),
-                skill.best ? skill.best : skill.pick_best(multiPV)));
+                skill.best ? skill.best : skill.pick_best(rootMoves, multiPV)));
 }
 
 
@@ -549,7 +680,6 @@ namespace {
 
     Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64];
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
     TTEntry* tte;
     Key posKey;
@@ -563,6 +693,7 @@ namespace {
 
     // Step 1. Initialize node
     Thread* thisThread = pos.this_thread();
+    TranspositionTable& tt = *thisThread->pool().tt;
     thisThread->depth  = depth;
     ss->inCheck        = pos.checkers();
     priorCapture       = pos.captured_piece();
@@ -572,7 +703,7 @@ namespace {
     maxValue           = VALUE_INFINITE;
 
     // Check for the available remaining time
-    if (thisThread == Threads.main())
+    if (thisThread == thisThread->pool().main())
         static_cast<MainThread*>(thisThread)->check_time();
 
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
@@ -582,7 +713,7 @@ namespace {
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (   Threads.stop.load(std::memory_order_relaxed)
+        if (   thisThread->pool().stop.load(std::memory_order_relaxed)
             || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos)
@@ -624,7 +755,8 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove == MOVE_NONE ? pos.key() : pos.key() ^ make_key(excludedMove);
-    tte = TT.probe(posKey, ss->ttHit);
+    tte = tt.probe(posKey, ss->ttHit);
+    thisThread->ttStats.on_probe(posKey, tte, ss->ttHit, depth, PvNode);
     ttValue = ss->ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
             : ss->ttHit    ? tte->move() : MOVE_NONE;
@@ -668,12 +800,13 @@ namespace {
     }
 
     // Step 5. Tablebases probe
-    if (!rootNode && TB::Cardinality)
+    if (!rootNode && thisThread->pool().tbConfig.cardinality)
     {
+        const TB::Config& tbConfig = thisThread->pool().tbConfig;
         int piecesCount = pos.count<ALL_PIECES>();
 
-        if (    piecesCount <= TB::Cardinality
-            && (piecesCount <  TB::Cardinality || depth >= TB::ProbeDepth)
+        if (    piecesCount <= tbConfig.cardinality
+            && (piecesCount <  tbConfig.cardinality || depth >= tbConfig.probeDepth)
             &&  pos.rule50_count() == 0
             && !pos.can_castle(ANY_CASTLING))
         {
@@ -681,14 +814,14 @@ namespace {
             TB::WDLScore wdl = Tablebases::probe_wdl(pos, &err);
 
             // Force check of time on the next occasion
-            if (thisThread == Threads.main())
+            if (thisThread == thisThread->pool().main())
                 static_cast<MainThread*>(thisThread)->callsCnt = 0;
 
             if (err != TB::ProbeState::FAIL)
             {
                 thisThread->tbHits.fetch_add(1, std::memory_order_relaxed);
 
-                int drawScore = TB::UseRule50 ? 1 : 0;
+                int drawScore = tbConfig.useRule50 ? 1 : 0;
 
                 // use the range VALUE_MATE_IN_MAX_PLY to VALUE_TB_WIN_IN_MAX_PLY to score
                 value =  wdl < -drawScore ? VALUE_MATED_IN_MAX_PLY + ss->ply + 1
@@ -701,9 +834,10 @@ namespace {
                 if (    b == BOUND_EXACT
                     || (b == BOUND_LOWER ? value >= beta : value <= alpha))
                 {
+                    thisThread->ttStats.on_save(posKey, tte, b, depth, PvNode);
                     tte->save(posKey, value_to_tt(value, ss->ply), ss->ttPv, b,
                               std::min(MAX_PLY - 1, depth + 6),
-                              MOVE_NONE, VALUE_NONE);
+                              MOVE_NONE, VALUE_NONE, tt.generation());
 
                     return value;
                 }
@@ -755,7 +889,10 @@ namespace {
 
         // Save static evaluation into transposition table
         if (!excludedMove)
-            tte->save(posKey, VALUE_NONE, ss->ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
+        {
+            thisThread->ttStats.on_save(posKey, tte, BOUND_NONE, depth, PvNode);
+            tte->save(posKey, VALUE_NONE, ss->ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval, tt.generation());
+        }
     }
 
     thisThread->complexityAverage.update(complexity);
@@ -893,7 +1030,8 @@ namespace {
                 if (value >= probCutBeta)
                 {
                     // Save ProbCut data into transposition table
-                    tte->save(posKey, value_to_tt(value, ss->ply), ss->ttPv, BOUND_LOWER, depth - 3, move, ss->staticEval);
+                    thisThread->ttStats.on_save(posKey, tte, BOUND_LOWER, depth, PvNode);
+                    tte->save(posKey, value_to_tt(value, ss->ply), ss->ttPv, BOUND_LOWER, depth - 3, move, ss->staticEval, tt.generation());
                     return value;
                 }
             }
@@ -975,8 +1113,11 @@ moves_loop: // When in check, search starts here
 
       ss->moveCount = ++moveCount;
 
-      if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
-          sync_cout << "info depth " << depth
+      if (   rootNode
+          && thisThread == thisThread->pool().main()
+          && !thisThread->pool().quiet
+          && thisThread->pool().time.elapsed() > 3000)
+          sync_cout << thisThread->pool().prefix << "info depth " << depth
                     << " currmove " << UCI::move(move, pos.is_chess960())
                     << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
       if (PvNode)
@@ -1117,7 +1258,7 @@ moves_loop: // When in check, search starts here
       ss->doubleExtensions = (ss-1)->doubleExtensions + (extension == 2);
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(tt.first_entry(pos.key_after(move)));
 
       // Update the current move (this must be done after singular extension search)
       ss->currentMove = move;
@@ -1235,7 +1376,7 @@ moves_loop: // When in check, search starts here
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (thisThread->pool().stop.load(std::memory_order_relaxed))
           return VALUE_ZERO;
 
       if (rootNode)
@@ -1366,10 +1507,14 @@ moves_loop: // When in check, search starts here
 
     // Write gathered information in transposition table
     if (!excludedMove && !(rootNode && thisThread->pvIdx))
-        tte->save(posKey, value_to_tt(bestValue, ss->ply), ss->ttPv,
-                  bestValue >= beta ? BOUND_LOWER :
-                  PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
-                  depth, bestMove, ss->staticEval);
+    {
+        Bound b = bestValue >= beta ? BOUND_LOWER :
+                  PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER;
+
+        thisThread->ttStats.on_save(posKey, tte, b, depth, PvNode);
+        tte->save(posKey, value_to_tt(bestValue, ss->ply), ss->ttPv, b,
+                  depth, bestMove, ss->staticEval, tt.generation());
+    }
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1392,7 +1537,6 @@ moves_loop: // When in check, search starts here
 
     Move pv[MAX_PLY+1];
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
     TTEntry* tte;
     Key posKey;
@@ -1409,6 +1553,7 @@ moves_loop: // When in check, search starts here
     }
 
     Thread* thisThread = pos.this_thread();
+    TranspositionTable& tt = *thisThread->pool().tt;
     bestMove = MOVE_NONE;
     ss->inCheck = pos.checkers();
     moveCount = 0;
@@ -1425,9 +1570,24 @@ moves_loop: // When in check, search starts here
     // only two types of depth in TT: DEPTH_QS_CHECKS or DEPTH_QS_NO_CHECKS.
     ttDepth = ss->inCheck || depth >= DEPTH_QS_CHECKS ? DEPTH_QS_CHECKS
                                                   : DEPTH_QS_NO_CHECKS;
-    // Transposition table lookup
+    // Transposition table lookup. The QSearchHash table of the thread, if any,
+    // is looked at first, and then only new non-PV entries are kept there.
     posKey = pos.key();
-    tte = TT.probe(posKey, ss->ttHit);
+    tte = thisThread->qsTable.probe(posKey, ss->ttHit);
+    if (!ss->ttHit)
+    {
+        TTEntry* qte = tte;
+
+        tte = tt.probe(posKey, ss->ttHit);
+        thisThread->ttStats.on_probe(posKey, tte, ss->ttHit, depth, PvNode);
+
+        if (qte)
+        {
+            thisThread->qsTable.mainHits += ss->ttHit;
+            if (!ss->ttHit && !PvNode)
+                tte = qte;
+        }
+    }
     ttValue = ss->ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove = ss->ttHit ? tte->move() : MOVE_NONE;
     pvHit = ss->ttHit && tte->is_pv();
@@ -1469,8 +1629,11 @@ moves_loop: // When in check, search starts here
         {
             // Save gathered info in transposition table
             if (!ss->ttHit)
+            {
+                thisThread->ttStats.on_save(posKey, tte, BOUND_LOWER, depth, PvNode);
                 tte->save(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER,
-                          DEPTH_NONE, MOVE_NONE, ss->staticEval);
+                          DEPTH_NONE, MOVE_NONE, ss->staticEval, tt.generation());
+            }
 
             return bestValue;
         }
@@ -1543,7 +1706,7 @@ moves_loop: // When in check, search starts here
           continue;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(tt.first_entry(pos.key_after(move)));
 
       ss->currentMove = move;
       ss->continuationHistory = &thisThread->continuationHistory[ss->inCheck]
@@ -1604,9 +1767,11 @@ moves_loop: // When in check, search starts here
     }
 
     // Save gathered info in transposition table
-    tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
-              bestValue >= beta ? BOUND_LOWER : BOUND_UPPER,
-              ttDepth, bestMove, ss->staticEval);
+    Bound b = bestValue >= beta ? BOUND_LOWER : BOUND_UPPER;
+
+    thisThread->ttStats.on_save(posKey, tte, b, depth, PvNode);
+    tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit, b,
+              ttDepth, bestMove, ss->staticEval, tt.generation());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1758,9 +1923,8 @@ moves_loop: // When in check, search starts here
   // When playing with strength handicap, choose best move among a set of RootMoves
   // using a statistical rule dependent on 'level'. Idea by Heinz van Saanen.
 
-  Move Skill::pick_best(size_t multiPV) {
+  Move Skill::pick_best(const RootMoves& rootMoves, size_t multiPV) {
 
-    const RootMoves& rootMoves = Threads.main()->rootMoves;
     static PRNG rng(now()); // PRNG sequence should be non-deterministic
 
     // RootMoves are already sorted by score in descending order
@@ -1799,13 +1963,14 @@ void MainThread::check_time() {
   if (--callsCnt > 0)
       return;
 
-  // When using nodes, ensure checking rate is not lower than 0.1% of nodes
-  callsCnt = Limits.nodes ? std::min(1024, int(Limits.nodes / 1024)) : 1024;
+  ThreadPool& threads = pool();
+  const Search::LimitsType& limits = threads.limits;
 
-  static TimePoint lastInfoTime = now();
+  // When using nodes, ensure checking rate is not lower than 0.1% of nodes
+  callsCnt = limits.nodes ? std::min(1024, int(limits.nodes / 1024)) : 1024;
 
-  TimePoint elapsed = Time.elapsed();
-  TimePoint tick = Limits.startTime + elapsed;
+  TimePoint elapsed = threads.time.elapsed();
+  TimePoint tick = limits.startTime + elapsed;
 
   if (tick - lastInfoTime >= 1000)
   {
@@ -1817,10 +1982,10 @@ void MainThread::check_time() {
   if (ponder)
       return;
 
-  if (   (Limits.use_time_management() && (elapsed > Time.maximum() - 10 || stopOnPonderhit))
-      || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
-      Threads.stop = true;
+  if (   (limits.use_time_management() && (elapsed > threads.time.maximum() - 10 || stopOnPonderhit))
+      || (limits.movetime && elapsed >= limits.movetime)
+      || (limits.nodes && threads.nodes_searched() >= (uint64_t)limits.nodes))
+      threads.stop = true;
 }
 
 
@@ -1830,12 +1995,13 @@ void MainThread::check_time() {
 string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 
   std::stringstream ss;
-  TimePoint elapsed = Time.elapsed() + 1;
+  const ThreadPool& threads = pos.this_thread()->pool();
+  TimePoint elapsed = threads.time.elapsed() + 1;
   const RootMoves& rootMoves = pos.this_thread()->rootMoves;
   size_t pvIdx = pos.this_thread()->pvIdx;
   size_t multiPV = std::min((size_t)Options["MultiPV"], rootMoves.size());
-  uint64_t nodesSearched = Threads.nodes_searched();
-  uint64_t tbHits = Threads.tb_hits() + (TB::RootInTB ? rootMoves.size() : 0);
+  uint64_t nodesSearched = threads.nodes_searched();
+  uint64_t tbHits = threads.tb_hits() + (threads.tbConfig.rootInTB ? rootMoves.size() : 0);
 
   for (size_t i = 0; i < multiPV; ++i)
   {
@@ -1850,13 +2016,13 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
       if (v == -VALUE_INFINITE)
           v = VALUE_ZERO;
 
-      bool tb = TB::RootInTB && abs(v) < VALUE_MATE_IN_MAX_PLY;
+      bool tb = threads.tbConfig.rootInTB && abs(v) < VALUE_MATE_IN_MAX_PLY;
       v = tb ? rootMoves[i].tbScore : v;
 
       if (ss.rdbuf()->in_avail()) // Not at first line
           ss << "\n";
 
-      ss << "info"
+      ss << threads.prefix << "info"
          << " depth "    << d
          << " seldepth " << rootMoves[i].selDepth
          << " multipv "  << i + 1
@@ -1872,7 +2038,7 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
          << " nps "      << nodesSearched * 1000 / elapsed;
 
       if (elapsed > 1000) // Earlier makes little sense
-          ss << " hashfull " << TT.hashfull();
+          ss << " hashfull " << threads.tt->hashfull();
 
       ss << " tbhits "   << tbHits
          << " time "     << elapsed
@@ -1894,7 +2060,6 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 bool RootMove::extract_ponder_from_tt(Position& pos) {
 
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
     bool ttHit;
 
@@ -1904,7 +2069,7 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry* tte = pos.this_thread()->pool().tt->probe(pos.key(), ttHit);
 
     if (ttHit)
     {
@@ -1917,36 +2082,39 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
     return pv.size() > 1;
 }
 
-void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+/// Tablebases::rank_root_moves() ranks the root moves by the tables, if the
+/// root is in them, and returns how the search should probe them.
 
-    RootInTB = false;
-    UseRule50 = bool(Options["Syzygy50MoveRule"]);
-    ProbeDepth = int(Options["SyzygyProbeDepth"]);
-    Cardinality = int(Options["SyzygyProbeLimit"]);
+Tablebases::Config Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+
+    Config config;
+    config.useRule50 = bool(Options["Syzygy50MoveRule"]);
+    config.probeDepth = int(Options["SyzygyProbeDepth"]);
+    config.cardinality = int(Options["SyzygyProbeLimit"]);
     bool dtz_available = true;
 
     // Tables with fewer pieces than SyzygyProbeLimit are searched with
-    // ProbeDepth == DEPTH_ZERO
-    if (Cardinality > MaxCardinality)
+    // probeDepth == DEPTH_ZERO
+    if (config.cardinality > MaxCardinality)
     {
-        Cardinality = MaxCardinality;
-        ProbeDepth = 0;
+        config.cardinality = MaxCardinality;
+        config.probeDepth = 0;
     }
 
-    if (Cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
+    if (config.cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
     {
         // Rank moves using DTZ tables
-        RootInTB = root_probe(pos, rootMoves);
+        config.rootInTB = root_probe(pos, rootMoves);
 
-        if (!RootInTB)
+        if (!config.rootInTB)
         {
             // DTZ tables are missing; try to rank moves using WDL tables
             dtz_available = false;
-            RootInTB = root_probe_wdl(pos, rootMoves);
+            config.rootInTB = root_probe_wdl(pos, rootMoves);
         }
     }
 
-    if (RootInTB)
+    if (config.rootInTB)
     {
         // Sort moves according to TB rank
         std::stable_sort(rootMoves.begin(), rootMoves.end(),
@@ -1954,7 +2122,7 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
 
         // Probe during search only if DTZ is not available and we are winning
         if (dtz_available || rootMoves[0].tbScore <= VALUE_DRAW)
-            Cardinality = 0;
+            config.cardinality = 0;
     }
     else
     {
@@ -1962,6 +2130,8 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
         for (auto& m : rootMoves)
             m.tbRank = 0;
     }
+
+    return config;
 }
 
 } // namespace Stockfish
@@ -104,8 +104,6 @@ struct LimitsType {
   int64_t nodes;
 };
 
-extern LimitsType Limits;
-
 void init();
 void clear();
 
@@ -19,6 +19,8 @@
 #ifndef STOCKFISH_SIMD_H_INCLUDED
 #define STOCKFISH_SIMD_H_INCLUDED
 
+#include "types.h" // For NNUE_ARCH_BEGIN
+
 #if defined(USE_AVX2)
 # include <immintrin.h>
 
@@ -54,6 +56,7 @@
 #endif
 
 namespace Stockfish::Simd {
+NNUE_ARCH_BEGIN
 
 #if defined (USE_AVX512)
 
@@ -382,6 +385,7 @@ namespace Stockfish::Simd {
 
 #endif
 
+NNUE_ARCH_END
 }
 
 #endif // STOCKFISH_SIMD_H_INCLUDED
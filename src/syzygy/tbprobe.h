@@ -43,6 +43,14 @@ enum ProbeState {
     ZEROING_BEST_MOVE =  2  // Best move zeroes DTZ (capture or pawn move)
 };
 
+// How the search of a position probes the tables, set up at its root
+struct Config {
+    int cardinality = 0;
+    bool rootInTB = false;
+    bool useRule50 = true;
+    Depth probeDepth = 0;
+};
+
 extern int MaxCardinality;
 
 void init(const std::string& paths);
@@ -50,7 +58,7 @@ WDLScore probe_wdl(Position& pos, ProbeState* result);
 int probe_dtz(Position& pos, ProbeState* result);
 bool root_probe(Position& pos, Search::RootMoves& rootMoves);
 bool root_probe_wdl(Position& pos, Search::RootMoves& rootMoves);
-void rank_root_moves(Position& pos, Search::RootMoves& rootMoves);
+Config rank_root_moves(Position& pos, Search::RootMoves& rootMoves);
 
 inline std::ostream& operator<<(std::ostream& os, const WDLScore v) {
 
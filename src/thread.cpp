@@ -19,6 +19,8 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <iomanip>
+#include <sstream>
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -30,11 +32,52 @@ namespace Stockfish {
 
 ThreadPool Threads; // Global object
 
+namespace {
+
+  // The pools with threads: the global one, the "batch" groups and the search
+  // contexts, which all follow the options read by their threads
+  std::vector<ThreadPool*> livePools;
+
+  void apply_options(ThreadPool& pool) {
+    pool.wakeupSpin = int(Options["Wakeup Spin"]);
+    pool.perfCounters = bool(Options["PerfCounters"]);
+  }
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  inline void cpu_relax() { __builtin_ia32_pause(); }
+#else
+  inline void cpu_relax() { std::this_thread::yield(); }
+#endif
+
+  // spin_until() busy waits for at most 'us' microseconds until cond() holds,
+  // and returns whether it did. A thread woken up, or finishing its search,
+  // within that time then avoids the latency of the condition variable.
+  template<typename Cond>
+  bool spin_until(int us, Cond cond) {
+
+    using namespace std::chrono;
+
+    const auto end = steady_clock::now() + microseconds(us);
+
+    do
+        for (int i = 0; i < 64; ++i)
+        {
+            if (cond())
+                return true;
+            cpu_relax();
+        }
+    while (steady_clock::now() < end);
+
+    return cond();
+  }
+
+} // namespace
+
 
 /// Thread constructor launches the thread and waits until it goes to sleep
 /// in idle_loop(). Note that 'searching' and 'exit' should be already set.
 
-Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
+Thread::Thread(size_t n, ThreadPool& tp) : owner(tp), idx(n), stdThread(&Thread::idle_loop, this) {
 
   wait_for_search_finished();
 }
@@ -60,6 +103,11 @@ void Thread::clear() {
   counterMoves.fill(MOVE_NONE);
   mainHistory.fill(0);
   captureHistory.fill(0);
+  ttStats.clear();
+  qsTable.resize(size_t(Options["QSearchHash"]));
+  evalCache.resize(size_t(Options["EvalCache"]));
+  accumulatorStats = Eval::NNUE::AccumulatorStats();
+  perf.clear();
   previousDepth = 0;
   
   for (bool inCheck : { false, true })
@@ -84,44 +132,81 @@ void Thread::start_searching() {
 
 
 /// Thread::wait_for_search_finished() blocks on the condition variable
-/// until the thread has finished searching.
+/// until the thread has finished searching, after spinning for a while
+/// if the Wakeup Spin option is set.
 
 void Thread::wait_for_search_finished() {
 
+  const int spin = owner.wakeupSpin.load(std::memory_order_relaxed);
+
+  if (spin && spin_until(spin, [&]{ return !searching; }))
+      return;
+
   std::unique_lock<std::mutex> lk(mutex);
   cv.wait(lk, [&]{ return !searching; });
 }
 
 
 /// Thread::idle_loop() is where the thread is parked, blocked on the
-/// condition variable, when it has no work to do.
+/// condition variable, when it has no work to do. With the Wakeup Spin
+/// option it first spins, outside of the lock, for a new search.
 
 void Thread::idle_loop() {
 
-  // If OS already scheduled us on a different group than 0 then don't overwrite
-  // the choice, eventually we are one of many one-threaded processes running on
-  // some Windows NUMA hardware, for instance in fishtest. To make it simple,
-  // just check if running threads are below a threshold, in this case all this
-  // NUMA machinery is not needed.
-  if (Options["Threads"] > 8)
-      WinProcGroup::bindThisThread(idx);
+  numaNode = ThreadPool::bind_this_thread(owner.bindBase + idx);
 
   while (true)
   {
       std::unique_lock<std::mutex> lk(mutex);
       searching = false;
       cv.notify_one(); // Wake up anyone waiting for search finished
-      cv.wait(lk, [&]{ return searching; });
+
+      const int spin = owner.wakeupSpin.load(std::memory_order_relaxed);
+      if (spin)
+      {
+          lk.unlock();
+          spin_until(spin, [&]{ return bool(searching); });
+          lk.lock();
+      }
+
+      cv.wait(lk, [&]{ return bool(searching); });
 
       if (exit)
           return;
 
+      wakeTime = std::chrono::steady_clock::now();
+
       lk.unlock();
 
       search();
   }
 }
 
+/// ThreadPool::bind_this_thread() binds the calling thread, which runs or serves
+/// the thread with index idx, according to the NumaPolicy option. Returns the
+/// NUMA node the thread was bound to, or -1.
+
+int ThreadPool::bind_this_thread(size_t idx) {
+
+  if (!(Options["NumaPolicy"] == "none"))
+  {
+      int node = Numa::bind_this_thread(idx, size_t(Options["Threads"]));
+      if (node >= 0)
+          return node;
+  }
+
+  // If OS already scheduled us on a different group than 0 then don't overwrite
+  // the choice, eventually we are one of many one-threaded processes running on
+  // some Windows NUMA hardware, for instance in fishtest. To make it simple,
+  // just check if running threads are below a threshold, in this case all this
+  // NUMA machinery is not needed.
+  if (Options["Threads"] > 8)
+      WinProcGroup::bindThisThread(idx);
+
+  return -1;
+}
+
+
 /// ThreadPool::set() creates/destroys threads to match the requested number.
 /// Created and launched threads will immediately go to sleep in idle_loop.
 /// Upon resizing, threads are recreated to allow for binding if necessary.
@@ -134,33 +219,77 @@ void ThreadPool::set(size_t requested) {
 
       while (size() > 0)
           delete back(), pop_back();
+
+      livePools.erase(std::remove(livePools.begin(), livePools.end(), this), livePools.end());
   }
 
   if (requested > 0)   // create new thread(s)
   {
-      push_back(new MainThread(0));
+      apply_options(*this);
+      livePools.push_back(this);
+
+      push_back(new MainThread(0, *this));
 
       while (size() < requested)
-          push_back(new Thread(size()));
+          push_back(new Thread(size(), *this));
+
+      // Reallocate the pawn and material tables from a thread bound like the
+      // owner, so that with a NUMA policy they are first touched on its node.
+      std::vector<std::thread> threads;
+      for (Thread* th : *this)
+          threads.emplace_back([this, th]() {
+              bind_this_thread(bindBase + th->id());
+              th->pawnsTable = Pawns::Table();
+              th->materialTable = Material::Table();
+          });
+
+      for (std::thread& t : threads)
+          t.join();
+
       clear();
 
-      // Reallocate the hash with the new threadpool size
-      TT.resize(size_t(Options["Hash"]));
+      // The other pools share the hash and the search params of the global one
+      if (this == &Threads)
+      {
+          // Reallocate the hash with the new threadpool size
+          TT.resize(size_t(Options["Hash"]));
 
-      // Init thread number dependent search params.
-      Search::init();
+          // Init thread number dependent search params.
+          Search::init();
+      }
   }
 }
 
 
-/// ThreadPool::clear() sets threadPool data to initial values
+/// ThreadPool::update_options() applies the options read by the threads while
+/// searching, like Wakeup Spin, to all the pools with threads.
+
+void ThreadPool::update_options() {
+
+  for (ThreadPool* pool : livePools)
+      apply_options(*pool);
+}
+
+
+/// ThreadPool::clear() sets threadPool data to initial values. The histories
+/// are cleared in parallel by threads bound like their owners, which also
+/// places them on the owner's node on first touch.
 
 void ThreadPool::clear() {
 
+  std::vector<std::thread> threads;
+
   for (Thread* th : *this)
-      th->clear();
+      threads.emplace_back([this, th]() {
+          bind_this_thread(bindBase + th->id());
+          th->clear();
+      });
+
+  for (std::thread& t : threads)
+      t.join();
 
   main()->callsCnt = 0;
+  main()->lastInfoTime = now();
   main()->bestPreviousScore = VALUE_INFINITE;
   main()->bestPreviousAverageScore = VALUE_INFINITE;
   main()->previousTimeReduction = 1.0;
@@ -171,14 +300,14 @@ void ThreadPool::clear() {
 /// returns immediately. Main thread will wake up other threads and start the search.
 
 void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
-                                const Search::LimitsType& limits, bool ponderMode) {
+                                const Search::LimitsType& goLimits, bool ponderMode) {
 
   main()->wait_for_search_finished();
 
   main()->stopOnPonderhit = stop = false;
   increaseDepth = true;
   main()->ponder = ponderMode;
-  Search::Limits = limits;
+  limits = goLimits;
   Search::RootMoves rootMoves;
 
   for (const auto& m : MoveList<LEGAL>(pos))
@@ -186,8 +315,8 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
           || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), m))
           rootMoves.emplace_back(m);
 
-  if (!rootMoves.empty())
-      Tablebases::rank_root_moves(pos, rootMoves);
+  tbConfig = rootMoves.empty() ? Tablebases::Config()
+                               : Tablebases::rank_root_moves(pos, rootMoves);
 
   // After ownership transfer 'states' becomes empty, so if we stop the search
   // and call 'go' again without setting a new position states.get() == NULL.
@@ -208,11 +337,27 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
       th->rootMoves = rootMoves;
       th->rootPos.set(pos.fen(), pos.is_chess960(), &th->rootState, th);
       th->rootState = setupStates->back();
+      th->rootState.accumulator = &th->accumulators[0];
+      th->accumulators[0].computed[WHITE] = th->accumulators[0].computed[BLACK] = false;
   }
 
   main()->start_searching();
 }
 
+
+/// ThreadPool::take_setup_states() gives back the states of the last position
+/// searched, so that the next position can extend them. While the search is
+/// running, "go infinite" or "go ponder" for instance, the states are still in
+/// use and none are given back: waiting here would block the UCI input loop.
+
+StateListPtr ThreadPool::take_setup_states() {
+
+  if (main()->is_searching())
+      return nullptr;
+
+  return std::move(setupStates);
+}
+
 Thread* ThreadPool::get_best_thread() const {
 
     Thread* bestThread = front();
@@ -245,6 +390,172 @@ Thread* ThreadPool::get_best_thread() const {
 }
 
 
+/// ThreadPool::numa_info() reports the NUMA placement: the fraction of the
+/// transposition table and of the per-thread data (histories) that is remote
+/// to the node each thread is bound to, averaged over the bound threads. As
+/// TT probes are uniformly spread, the former is the expected remote probe rate.
+
+std::string ThreadPool::numa_info() const {
+
+  std::stringstream ss;
+  double ttRemote = 0, dataRemote = 0;
+  size_t bound = 0;
+
+  for (Thread* th : *this)
+      if (th->numa_node() >= 0)
+      {
+          ++bound;
+          ttRemote   += TT.remote_ratio(th->numa_node());
+          dataRemote += Numa::remote_ratio(th, sizeof(Thread), th->numa_node());
+      }
+
+  ss << "NUMA nodes " << Numa::nodes()
+     << " policy "    << std::string(Options["NumaPolicy"])
+     << " bound "     << bound << "/" << size() << std::fixed << std::setprecision(1)
+     << " TT remote " << (bound ? 100 * ttRemote / bound : 0.0) << "%"
+     << " thread data remote " << (bound ? 100 * dataRemote / bound : 0.0) << "%";
+
+  return ss.str();
+}
+
+
+/// ThreadPool::tt_stats() reports the transposition table counters summed over
+/// all the threads, since the last ucinewgame.
+
+std::string ThreadPool::tt_stats() const {
+
+  TTStats total;
+
+  for (Thread* th : *this)
+      total += th->ttStats;
+
+  return total.report();
+}
+
+
+/// ThreadPool::qsearch_stats() reports how the QSearchHash tables did, summed
+/// over all the threads: each of their hits is a main table lookup saved.
+
+std::string ThreadPool::qsearch_stats() const {
+
+  uint64_t probes = 0, hits = 0, mainHits = 0;
+
+  for (Thread* th : *this)
+  {
+      probes   += th->qsTable.probes;
+      hits     += th->qsTable.hits;
+      mainHits += th->qsTable.mainHits;
+  }
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1)
+     << "QSearchHash probes " << probes << " hits " << hits
+     << " hitrate " << (probes ? 100.0 * hits / probes : 0.0) << "%"
+     << " (main table lookups saved), main table hits after a miss " << mainHits
+     << " of " << probes - hits;
+
+  return ss.str();
+}
+
+
+/// ThreadPool::eval_cache_stats() reports how the EvalCache tables did, summed
+/// over all the threads: each of their hits is an NNUE evaluation saved.
+
+std::string ThreadPool::eval_cache_stats() const {
+
+  uint64_t probes = 0, hits = 0;
+
+  for (Thread* th : *this)
+  {
+      probes += th->evalCache.probes;
+      hits   += th->evalCache.hits;
+  }
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1)
+     << "EvalCache probes " << probes << " hits " << hits
+     << " hitrate " << (probes ? 100.0 * hits / probes : 0.0) << "%"
+     << " (NNUE evaluations saved)";
+
+  return ss.str();
+}
+
+
+/// ThreadPool::accumulator_stats() reports the NNUE accumulator work summed
+/// over all the threads since the last ucinewgame, or an empty string if there
+/// was none. Each of the given nodes searched since then could need two
+/// accumulators, one per perspective: the ones neither refreshed nor stored by
+/// an incremental pass are the updates avoided.
+
+std::string ThreadPool::accumulator_stats(uint64_t nodes) const {
+
+  Eval::NNUE::AccumulatorStats total{};
+
+  for (Thread* th : *this)
+  {
+      const auto& s = th->accumulatorStats;
+      total.evaluations  += s.evaluations;
+      total.updates      += s.updates;
+      total.pliesUpdated += s.pliesUpdated;
+      total.stores       += s.stores;
+      total.refreshes    += s.refreshes;
+  }
+
+  if (!total.evaluations)
+      return "";
+
+  const uint64_t computed = total.stores + total.refreshes;
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2)
+     << "NNUE evaluations " << total.evaluations
+     << " refreshes " << total.refreshes
+     << " updates " << total.updates
+     << " plies per update " << (total.updates ? double(total.pliesUpdated) / total.updates : 0.0)
+     << " accumulators computed " << computed
+     << " avoided " << (2 * nodes > computed ? 2 * nodes - computed : 0);
+
+  return ss.str();
+}
+
+
+/// ThreadPool::perf_stats() reports the hardware counters of the PerfCounters
+/// option summed over all the threads, for the last search or since the last
+/// ucinewgame, in total and per node of the given nodes searched.
+
+std::string ThreadPool::perf_stats(bool lastSearch, uint64_t nodes) const {
+
+  uint64_t total[PerfCounters::EVENT_NB] = {};
+  bool available[PerfCounters::EVENT_NB] = {};
+
+  for (Thread* th : *this)
+      for (int e = 0; e < PerfCounters::EVENT_NB; ++e)
+      {
+          total[e] += lastSearch ? th->perf.last[e] : th->perf.total[e];
+          available[e] |= th->perf.available(PerfCounters::Event(e));
+      }
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2) << "Perf counters";
+
+  for (int e = 0; e < PerfCounters::EVENT_NB; ++e)
+  {
+      ss << " " << PerfCounters::name(PerfCounters::Event(e));
+
+      if (!available[e])
+          ss << " n/a";
+      else
+          ss << " " << total[e] << " (" << double(total[e]) / std::max(nodes, uint64_t(1)) << "/node)";
+  }
+
+  if (available[PerfCounters::Cycles] && available[PerfCounters::Instructions])
+      ss << " IPC " << double(total[PerfCounters::Instructions])
+                     / std::max(total[PerfCounters::Cycles], uint64_t(1));
+
+  return ss.str();
+}
+
+
 /// Start non-main threads
 
 void ThreadPool::start_searching() {
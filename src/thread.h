@@ -20,6 +20,7 @@
 #define THREAD_H_INCLUDED
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
@@ -31,9 +32,14 @@
 #include "position.h"
 #include "search.h"
 #include "thread_win32_osx.h"
+#include "timeman.h"
+#include "tt.h"
+#include "syzygy/tbprobe.h"
 
 namespace Stockfish {
 
+struct ThreadPool;
+
 /// Thread class keeps together all the thread-related stuff. We use
 /// per-thread pawn and material hash tables so that once we get a
 /// pointer to an entry its life time is unlimited and we don't have
@@ -43,12 +49,15 @@ class Thread {
 
   std::mutex mutex;
   std::condition_variable cv;
+  ThreadPool& owner;
   size_t idx;
-  bool exit = false, searching = true; // Set before starting std::thread
+  int numaNode = -1;
+  bool exit = false; // Set before starting std::thread
+  std::atomic_bool searching = true;
   NativeThread stdThread;
 
 public:
-  explicit Thread(size_t);
+  Thread(size_t, ThreadPool&);
   virtual ~Thread();
   virtual void search();
   void clear();
@@ -56,9 +65,20 @@ public:
   void start_searching();
   void wait_for_search_finished();
   size_t id() const { return idx; }
+  bool is_searching() const { return searching; }
+  ThreadPool& pool() const { return owner; }
+  int numa_node() const { return numaNode; }
 
   Pawns::Table pawnsTable;
   Material::Table materialTable;
+  TTStats ttStats;
+  QSearchTable qsTable;
+  Eval::NNUE::AccumulatorCache accumulatorCache;
+  Eval::NNUE::EvalCache evalCache;
+  Eval::NNUE::AccumulatorStats accumulatorStats;
+  PerfCounters perf;
+  Eval::NNUE::Accumulator accumulators[MAX_PLY + 10]; // Indexed by ply, see StateInfo
+  std::chrono::steady_clock::time_point wakeTime; // Start of the last search
   size_t pvIdx, pvLast;
   RunningAverage complexityAverage;
   std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
@@ -92,6 +112,8 @@ struct MainThread : public Thread {
   Value bestPreviousScore;
   Value bestPreviousAverageScore;
   Value iterValue[4];
+  TimePoint depthTime[MAX_PLY]; // Time elapsed when each depth was completed
+  TimePoint lastInfoTime;
   int callsCnt;
   bool stopOnPonderhit;
   std::atomic_bool ponder;
@@ -100,11 +122,15 @@ struct MainThread : public Thread {
 
 /// ThreadPool struct handles all the threads-related stuff like init, starting,
 /// parking and, most importantly, launching a thread. All the access to threads
-/// is done through this class.
+/// is done through this class. It also holds the state of the current search
+/// shared by its threads, so that several pools can search at the same time.
+/// Each pool searches the table tt points to: the global one by default, as for
+/// the "batch" groups, or the own table of a search context (see "context").
 
 struct ThreadPool : public std::vector<Thread*> {
 
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
+  StateListPtr take_setup_states();
   void clear();
   void set(size_t);
 
@@ -114,8 +140,27 @@ struct ThreadPool : public std::vector<Thread*> {
   Thread* get_best_thread() const;
   void start_searching();
   void wait_for_search_finished() const;
+  std::string numa_info() const;
+  std::string tt_stats() const;
+  std::string qsearch_stats() const;
+  std::string eval_cache_stats() const;
+  std::string accumulator_stats(uint64_t nodes) const;
+  std::string perf_stats(bool lastSearch, uint64_t nodes) const;
+
+  static int bind_this_thread(size_t idx);
+  static void update_options();
 
   std::atomic_bool stop, increaseDepth;
+  std::atomic<int> wakeupSpin; // Microseconds to spin before sleeping
+  std::atomic_bool perfCounters; // Count hardware events of the searches
+  Search::LimitsType limits;
+  TimeManagement time{*this};
+  Tablebases::Config tbConfig;
+  size_t bindBase = 0; // Index of the first thread for NUMA binding
+  bool quiet = false;  // No UCI output, the searches are reported by the caller
+  std::string prefix;  // Written before each UCI output line, see "context"
+  TranspositionTable* tt = &TT;
+  Thread* lastBestThread = nullptr; // Whose result the last search reported
 
 private:
   StateListPtr setupStates;
@@ -21,13 +21,12 @@
 #include <cmath>
 
 #include "search.h"
+#include "thread.h"
 #include "timeman.h"
 #include "uci.h"
 
 namespace Stockfish {
 
-TimeManagement Time; // Our global time management object
-
 
 /// TimeManagement::init() is called at the beginning of the search and calculates
 /// the bounds of time allowed for the current game ply. We currently support:
@@ -102,4 +101,13 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
       optimumTime += optimumTime / 4;
 }
 
+
+/// TimeManagement::elapsed() returns the time since the search started, or the
+/// nodes searched by the threads of the pool when in 'nodes as time' mode.
+
+TimePoint TimeManagement::elapsed() const {
+
+  return threads.limits.npmsec ? TimePoint(threads.nodes_searched()) : now() - startTime;
+}
+
 } // namespace Stockfish
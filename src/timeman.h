@@ -21,31 +21,32 @@
 
 #include "misc.h"
 #include "search.h"
-#include "thread.h"
 
 namespace Stockfish {
 
+struct ThreadPool;
+
 /// The TimeManagement class computes the optimal time to think depending on
 /// the maximum available time, the game move number and other parameters.
+/// Each ThreadPool has its own, for the searches of its threads.
 
 class TimeManagement {
 public:
+  explicit TimeManagement(const ThreadPool& tp) : threads(tp) {}
   void init(Search::LimitsType& limits, Color us, int ply);
   TimePoint optimum() const { return optimumTime; }
   TimePoint maximum() const { return maximumTime; }
-  TimePoint elapsed() const { return Search::Limits.npmsec ?
-                                     TimePoint(Threads.nodes_searched()) : now() - startTime; }
+  TimePoint elapsed() const;
 
-  int64_t availableNodes; // When in 'nodes as time' mode
+  int64_t availableNodes = 0; // When in 'nodes as time' mode
 
 private:
+  const ThreadPool& threads;
   TimePoint startTime;
   TimePoint optimumTime;
   TimePoint maximumTime;
 };
 
-extern TimeManagement Time;
-
 } // namespace Stockfish
 
 #endif // #ifndef TIMEMAN_H_INCLUDED
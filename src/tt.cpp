@@ -16,10 +16,22 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
 #include <cstring>   // For std::memset
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <thread>
 
+#if !defined(_WIN32)
+#include <chrono>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "bitboard.h"
 #include "misc.h"
 #include "thread.h"
@@ -30,45 +42,105 @@ namespace Stockfish {
 
 TranspositionTable TT; // Our global transposition table
 
+/// SharedHeader is the first page of a shared memory segment holding a table.
+/// Processes attaching to the segment wait for 'ready', set by its creator once
+/// the header is filled in, and the last one to detach removes the segment.
+
+struct TranspositionTable::SharedHeader {
+  char                  magic[8];
+  uint64_t              clusterCount;
+  uint32_t              clusterBytes;
+  uint32_t              sealed;
+  std::atomic<uint32_t> ready, users;
+  std::atomic<uint8_t>  generation8;
+  std::atomic<int64_t>  lastNewSearch;
+  char                  name[256];
+};
+
+
 /// TTEntry::save() populates the TTEntry with a new node's data, possibly
-/// overwriting an old position. Update is not atomic and can be racy.
+/// overwriting an old position. Update is not atomic and can be racy, but with
+/// TT_LOCKLESS the key is sealed last so that torn entries fail verification.
+/// The generation is the one of the table searched, see TranspositionTable.
 
-void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
+
+  const uint16_t oldKey16 = key();
 
   // Preserve any existing move for the same position
-  if (m || (uint16_t)k != key16)
+  if (m || (uint16_t)k != oldKey16)
       move16 = (uint16_t)m;
 
   // Overwrite less valuable entries (cheapest checks first)
   if (   b == BOUND_EXACT
-      || (uint16_t)k != key16
+      || (uint16_t)k != oldKey16
       || d - DEPTH_OFFSET + 2 * pv > depth8 - 4)
   {
       assert(d > DEPTH_OFFSET);
       assert(d < 256 + DEPTH_OFFSET);
 
-      key16     = (uint16_t)k;
       depth8    = (uint8_t)(d - DEPTH_OFFSET);
-      genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
+      genBound8 = (uint8_t)(generation8 | uint8_t(pv) << 2 | b);
       value16   = (int16_t)v;
       eval16    = (int16_t)ev;
+      seal((uint16_t)k);
+
+#if defined(TT_STATS)
+      if (TT.owns(this))
+          TT.debugKeys[TT.entry_index(this)] = k;
+#endif
   }
+#if defined(TT_LOCKLESS)
+  else
+      seal(oldKey16); // The move may have changed
+#endif
 }
 
 
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// The entries of the previous table, if any, are migrated into the new one,
+/// unless there is not enough memory to hold both at the same time.
 
 void TranspositionTable::resize(size_t mbSize) {
 
-  Threads.main()->wait_for_search_finished();
+  // The table of a search context is resized by its owner, between searches
+  if (this == &TT)
+      Threads.main()->wait_for_search_finished();
 
-  aligned_large_pages_free(table);
+  const std::string sharedName = Options["SharedHash"];
+
+  // A shared table lives on in its segment, so there is nothing to migrate.
+  // Only the global table is shared, not those of the search contexts.
+  if (sharedName != "<empty>" && this == &TT)
+  {
+      free_table(table, mappedSize, shared);
+      table = nullptr, mappedSize = 0, shared = nullptr;
+
+      if (attach(sharedName, mbSize))
+          return;
+
+      sync_cout << "info string Failed to attach to the shared hash " << sharedName
+                << ", using a private one" << sync_endl;
+  }
+
+  Cluster* oldTable = table;
+  SharedHeader* oldShared = shared;
+  const size_t oldCount = clusterCount, oldMapped = mappedSize;
 
   clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+  mappedSize = 0;
+  shared = nullptr;
 
   table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+  if (!table && oldTable)
+  {
+      free_table(oldTable, oldMapped, oldShared);
+      oldTable = nullptr;
+      table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+  }
+
   if (!table)
   {
       std::cerr << "Failed to allocate " << mbSize
@@ -76,15 +148,279 @@ void TranspositionTable::resize(size_t mbSize) {
       exit(EXIT_FAILURE);
   }
 
-  clear();
+  // Spread the pages over all nodes as they are first touched
+  if (Options["NumaPolicy"] == "interleave")
+      Numa::interleave(table, clusterCount * sizeof(Cluster));
+
+  if (oldTable)
+  {
+      migrate(oldTable, oldCount);
+      free_table(oldTable, oldMapped, oldShared);
+  }
+  else
+      zero();
+
+  epoch16 = 0;
+
+#if defined(TT_STATS)
+  debugKeys.assign(clusterCount * ClusterSize, 0); // Keys of migrated entries are unknown
+#endif
 }
 
 
-/// TranspositionTable::clear() initializes the entire transposition table to zero,
-//  in a multi-threaded way.
+/// TranspositionTable::migrate() fills the table, in a multi-threaded way, with
+/// the entries of a table of a different size, skipping stale clusters. Only the low 16 bits of the keys
+/// are stored, so each of our clusters takes the entries of the old clusters
+/// covering the same key range, as given by mul_hi64(), keeping the most
+/// valuable ones. When growing, an old cluster is copied into all the clusters
+/// splitting its range and only one copy is reachable, the others are replaced
+/// as the search goes on.
+
+void TranspositionTable::migrate(const Cluster* from, size_t fromCount) {
+
+  std::vector<std::thread> threads;
+
+  for (size_t idx = 0; idx < Options["Threads"]; ++idx)
+  {
+      threads.emplace_back([this, idx, from, fromCount]() {
+
+          // Thread binding gives faster search on systems with a first-touch policy
+          ThreadPool::bind_this_thread(idx);
+
+          // Each thread will fill its part of the hash table
+          const size_t stride = size_t(clusterCount / Options["Threads"]),
+                       start  = size_t(stride * idx),
+                       len    = idx != Options["Threads"] - 1 ?
+                                stride : clusterCount - start;
+
+          const uint64_t step = ~uint64_t(0) / clusterCount;
+
+          auto value = [&](const TTEntry& tte) {
+              return tte.depth8 - ((GENERATION_CYCLE + generation8 - tte.genBound8) & GENERATION_MASK);
+          };
+
+          for (size_t i = start; i < start + len; ++i)
+          {
+              Cluster& cluster = table[i];
+              std::memset(&cluster, 0, sizeof(Cluster));
+
+              const size_t first = size_t(mul_hi64(i * step, fromCount)),
+                           last  = std::min(size_t(mul_hi64(i * step + step - 1, fromCount)), fromCount - 1);
+
+              for (size_t j = first; j <= last; ++j)
+                  for (const TTEntry& tte : from[j].entry)
+                  {
+                      if (!tte.depth8 || from[j].epoch16 != epoch16)
+                          continue;
+
+                      TTEntry* replace = &cluster.entry[0];
+                      for (TTEntry& e : cluster.entry)
+                          if (!e.depth8 || value(e) < value(*replace))
+                          {
+                              replace = &e;
+                              if (!e.depth8)
+                                  break;
+                          }
+
+                      if (!replace->depth8 || value(tte) > value(*replace))
+                          *replace = tte;
+                  }
+          }
+      });
+  }
+
+  for (std::thread& th : threads)
+      th.join();
+}
+
+
+/// TranspositionTable::attach() maps the table from the POSIX shared memory
+/// segment 'name', creating it with a size of mbSize megabytes if it does not
+/// exist yet. Otherwise the table of the segment is used as is, whatever the
+/// Hash option of this process.
+
+bool TranspositionTable::attach(const std::string& name, size_t mbSize) {
+
+#if defined(_WIN32)
+  (void)name, (void)mbSize;
+  return false;
+#else
+  static_assert(sizeof(SharedHeader) <= FileHeaderSize, "SharedHeader must fit in the header page");
+
+  const std::string shmName = name[0] == '/' ? name : "/" + name;
+  size_t count = mbSize * 1024 * 1024 / sizeof(Cluster);
+  struct stat st;
+
+  int fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  const bool creator = fd != -1;
+
+  // The segment of a creator is zero filled by ftruncate(), thus an empty table
+  if (creator && ftruncate(fd, off_t(FileHeaderSize + count * sizeof(Cluster))))
+  {
+      close(fd);
+      shm_unlink(shmName.c_str());
+      return false;
+  }
+
+  if (!creator)
+  {
+      fd = shm_open(shmName.c_str(), O_RDWR, 0600);
+
+      // Give the creator some time to size the segment
+      for (int i = 0; fd != -1 && !fstat(fd, &st) && size_t(st.st_size) <= FileHeaderSize && i < 1000; ++i)
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+      if (fd == -1 || fstat(fd, &st) || size_t(st.st_size) <= FileHeaderSize)
+      {
+          if (fd != -1)
+              close(fd);
+          return false;
+      }
+
+      count = (size_t(st.st_size) - FileHeaderSize) / sizeof(Cluster);
+  }
+
+  void* addr = mmap(nullptr, FileHeaderSize + count * sizeof(Cluster),
+                    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (addr == MAP_FAILED)
+  {
+      if (creator)
+          shm_unlink(shmName.c_str());
+      return false;
+  }
+
+  SharedHeader* sh = static_cast<SharedHeader*>(addr);
+  bool sealed = false;
+#if defined(TT_LOCKLESS)
+  sealed = true;
+#endif
+
+  if (creator)
+  {
+      std::strncpy(sh->magic, "SFSHM1", sizeof(sh->magic));
+      std::strncpy(sh->name, shmName.c_str(), sizeof(sh->name) - 1);
+      sh->clusterCount = count;
+      sh->clusterBytes = sizeof(Cluster);
+      sh->sealed = sealed;
+      sh->users = 1;
+      sh->ready.store(1, std::memory_order_release);
+  }
+  else
+  {
+      for (int i = 0; !sh->ready.load(std::memory_order_acquire) && i < 10000; ++i)
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+      if (   !sh->ready
+          || std::strncmp(sh->magic, "SFSHM1", sizeof(sh->magic))
+          || sh->clusterCount != count
+          || sh->clusterBytes != sizeof(Cluster)
+          || bool(sh->sealed) != sealed)
+      {
+          munmap(addr, FileHeaderSize + count * sizeof(Cluster));
+          return false;
+      }
+
+      ++sh->users;
+  }
+
+  shared = sh;
+  table = reinterpret_cast<Cluster*>(static_cast<char*>(addr) + FileHeaderSize);
+  clusterCount = count;
+  mappedSize = count * sizeof(Cluster);
+  generation8 = sh->generation8;
+  epoch16 = 0;
+
+#if defined(MADV_HUGEPAGE)
+  madvise(table, mappedSize, MADV_HUGEPAGE);
+#endif
+
+#if defined(TT_STATS)
+  debugKeys.assign(clusterCount * ClusterSize, 0);
+#endif
+
+  sync_cout << "info string " << (creator ? "Created" : "Attached to") << " shared hash "
+            << name << " (" << mappedSize / (1024 * 1024) << "MB, "
+            << sh->users << " processes)" << sync_endl;
+  return true;
+#endif
+}
+
+
+/// TranspositionTable::free_table() releases a table, which is either our own
+/// allocation, a private mapping of a hash file or a shared memory segment.
+/// The last process detaching from a segment removes it.
+
+void TranspositionTable::free_table(Cluster* mem, size_t mapped, SharedHeader* sh) {
+
+#if !defined(_WIN32)
+  if (sh)
+  {
+      std::string name = sh->name;
+      bool last = --sh->users == 0;
+
+      munmap(sh, FileHeaderSize + mapped);
+      if (last)
+          shm_unlink(name.c_str());
+      return;
+  }
+
+  if (mapped)
+  {
+      munmap(mem, mapped);
+      return;
+  }
+#else
+  (void)mapped, (void)sh;
+#endif
+
+  aligned_large_pages_free(mem);
+}
+
+
+/// TranspositionTable::clear() empties the table in constant time by moving to
+/// a new epoch. Clusters are zeroed lazily, when next probed. Only when the epoch
+/// counter wraps around the whole table is zeroed.
 
 void TranspositionTable::clear() {
 
+  // A shared table is in use by other processes too, so leave it alone. It is
+  // empty when its segment is created.
+  if (shared)
+      return;
+
+  if (++epoch16 == 0)
+      zero();
+}
+
+
+/// TranspositionTable::new_search() moves to a new generation, so that entries
+/// from previous searches age. Processes sharing a table search concurrently,
+/// so the shared generation is advanced at most once per second, by whichever
+/// process comes first, otherwise their entries would age much too fast.
+
+void TranspositionTable::new_search() {
+
+  if (!shared)
+  {
+      generation8 += GENERATION_DELTA; // Lower bits are used for other things
+      return;
+  }
+
+  int64_t last = shared->lastNewSearch;
+  if (now() - last >= 1000 && shared->lastNewSearch.compare_exchange_strong(last, now()))
+      shared->generation8 += GENERATION_DELTA;
+
+  generation8 = shared->generation8;
+}
+
+
+/// TranspositionTable::zero() initializes the entire transposition table to zero,
+//  in a multi-threaded way.
+
+void TranspositionTable::zero() {
+
   std::vector<std::thread> threads;
 
   for (size_t idx = 0; idx < Options["Threads"]; ++idx)
@@ -92,8 +428,7 @@ void TranspositionTable::clear() {
       threads.emplace_back([this, idx]() {
 
           // Thread binding gives faster search on systems with a first-touch policy
-          if (Options["Threads"] > 8)
-              WinProcGroup::bindThisThread(idx);
+          ThreadPool::bind_this_thread(idx);
 
           // Each thread will zero its part of the hash table
           const size_t stride = size_t(clusterCount / Options["Threads"]),
@@ -119,11 +454,23 @@ void TranspositionTable::clear() {
 
 TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
 
-  TTEntry* const tte = first_entry(key);
+  Cluster* const cluster = &table[mul_hi64(key, clusterCount)];
+  TTEntry* const tte = &cluster->entry[0];
   const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
 
+  // Lazily empty the clusters left over from before the last clear()
+  if (cluster->epoch16 != epoch16)
+  {
+      std::memset(tte, 0, sizeof(cluster->entry));
+      cluster->epoch16 = epoch16;
+
+#if defined(TT_STATS)
+      std::fill_n(&const_cast<TranspositionTable*>(this)->debugKeys[entry_index(tte)], ClusterSize, 0);
+#endif
+  }
+
   for (int i = 0; i < ClusterSize; ++i)
-      if (tte[i].key16 == key16 || !tte[i].depth8)
+      if (tte[i].key() == key16 || !tte[i].depth8)
       {
           tte[i].genBound8 = uint8_t(generation8 | (tte[i].genBound8 & (GENERATION_DELTA - 1))); // Refresh
 
@@ -154,9 +501,308 @@ int TranspositionTable::hashfull() const {
   int cnt = 0;
   for (int i = 0; i < 1000; ++i)
       for (int j = 0; j < ClusterSize; ++j)
-          cnt += table[i].entry[j].depth8 && (table[i].entry[j].genBound8 & GENERATION_MASK) == generation8;
+          cnt +=  table[i].epoch16 == epoch16
+               && table[i].entry[j].depth8
+               && (table[i].entry[j].genBound8 & GENERATION_MASK) == generation8;
 
   return cnt / ClusterSize;
 }
 
+
+/// TranspositionTable::save() writes the table, with its size and generation,
+/// to a file. Entries shallower than minDepth are dropped, and runs of empty
+/// clusters are skipped with a seek, so that on file systems supporting sparse
+/// files they take no space.
+
+bool TranspositionTable::save(const std::string& fname, Depth minDepth) const {
+
+  Threads.main()->wait_for_search_finished();
+
+  FileHeader header = { "SFHASH1", clusterCount, sizeof(Cluster), 0, generation8 };
+#if defined(TT_LOCKLESS)
+  header.sealed = 1;
+#endif
+
+  std::ofstream stream(fname, std::ios::binary);
+  char page[FileHeaderSize] = {};
+  std::memcpy(page, &header, sizeof(header));
+  stream.write(page, FileHeaderSize);
+
+  constexpr size_t ChunkSize = FileHeaderSize / sizeof(Cluster);
+  Cluster chunk[ChunkSize];
+
+  for (size_t start = 0; start < clusterCount && stream; start += ChunkSize)
+  {
+      const size_t len = std::min(ChunkSize, clusterCount - start);
+      bool empty = true;
+
+      std::memcpy(chunk, &table[start], len * sizeof(Cluster));
+
+      for (size_t i = 0; i < len; ++i)
+      {
+          // Stale clusters are saved empty and the others in epoch zero,
+          // which is the epoch of a loaded table.
+          if (chunk[i].epoch16 != epoch16)
+              std::memset(&chunk[i], 0, sizeof(Cluster));
+
+          chunk[i].epoch16 = 0;
+
+          for (TTEntry& tte : chunk[i].entry)
+          {
+              if (tte.depth8 && tte.depth() < minDepth)
+                  std::memset(&tte, 0, sizeof(TTEntry));
+
+              empty &= !tte.depth8;
+          }
+      }
+
+      // Always write the last chunk, so that the file gets its full size
+      if (empty && start + len < clusterCount)
+          stream.seekp(len * sizeof(Cluster), std::ios::cur);
+      else
+          stream.write(reinterpret_cast<const char*>(chunk), len * sizeof(Cluster));
+  }
+
+  bool saved = bool(stream);
+
+  sync_cout << (saved ? "info string Hash saved successfully to " + fname
+                      : "info string Failed to save the hash to " + fname) << sync_endl;
+  return saved;
+}
+
+
+/// TranspositionTable::load() replaces the table with the content of a file
+/// written by save(). Where possible the file is mapped copy-on-write, so the
+/// table starts warm without reading or zeroing it upfront: pages are faulted
+/// in from the page cache as they are probed. The size of the loaded table is
+/// the one of the file, regardless of the Hash option.
+
+bool TranspositionTable::load(const std::string& fname) {
+
+  Threads.main()->wait_for_search_finished();
+
+  FileHeader header;
+  std::ifstream stream(fname, std::ios::binary);
+  stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  bool sealed = false;
+#if defined(TT_LOCKLESS)
+  sealed = true;
+#endif
+
+  if (   !stream
+      || std::strncmp(header.magic, "SFHASH1", sizeof(header.magic))
+      || header.clusterBytes != sizeof(Cluster)
+      || bool(header.sealed) != sealed
+      || !header.clusterCount)
+  {
+      sync_cout << "info string Failed to load the hash from " + fname
+                   + ", not a compatible hash file" << sync_endl;
+      return false;
+  }
+
+  const size_t size = header.clusterCount * sizeof(Cluster);
+  Cluster* mem = nullptr;
+  bool mapped = false;
+
+#if !defined(_WIN32)
+  int fd = open(fname.c_str(), O_RDONLY);
+  struct stat st;
+
+  if (fd != -1 && !fstat(fd, &st) && size_t(st.st_size) >= FileHeaderSize + size)
+  {
+      void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, FileHeaderSize);
+      if (addr != MAP_FAILED)
+      {
+          madvise(addr, size, MADV_WILLNEED); // Start reading ahead in the background
+          mem = static_cast<Cluster*>(addr);
+          mapped = true;
+      }
+  }
+
+  if (fd != -1)
+      close(fd);
+#endif
+
+  // Otherwise read the file into a table of our own: on Windows, or when the
+  // table does not start at a page boundary of the file, with pages over 4K.
+  if (!mem)
+  {
+      mem = static_cast<Cluster*>(aligned_large_pages_alloc(size));
+      stream.seekg(FileHeaderSize);
+      if (mem && !stream.read(reinterpret_cast<char*>(mem), size))
+      {
+          aligned_large_pages_free(mem);
+          mem = nullptr;
+      }
+  }
+
+  if (!mem)
+  {
+      sync_cout << "info string Failed to load the hash from " + fname << sync_endl;
+      return false;
+  }
+
+  free_table(table, mappedSize, shared);
+  shared = nullptr;
+  mappedSize = mapped ? size : 0;
+
+  table = mem;
+  clusterCount = header.clusterCount;
+  generation8 = header.generation8;
+  epoch16 = 0;
+
+#if defined(TT_STATS)
+  debugKeys.assign(clusterCount * ClusterSize, 0);
+#endif
+
+  sync_cout << "info string Hash loaded successfully from " + fname << " ("
+            << size / (1024 * 1024) << "MB)" << sync_endl;
+  return true;
+}
+
+
+/// QSearchTable::resize() sets the size of the table in kilobytes, 0 disables
+/// it. The table is emptied and its counters reset in any case.
+
+void QSearchTable::resize(size_t kbSize) {
+
+  const size_t count = kbSize * 1024 / sizeof(TTEntry);
+
+  if (count != entries.size())
+      entries = std::vector<TTEntry>(count);
+
+  clear();
+}
+
+
+void QSearchTable::clear() {
+
+  std::fill(entries.begin(), entries.end(), TTEntry());
+  probes = hits = mainHits = 0;
+}
+
+
+#if defined(TT_STATS)
+
+/// TTStats::on_probe() records the outcome of TranspositionTable::probe()
+
+void TTStats::on_probe(Key key, const TTEntry* tte, bool found, Depth d, bool pv) {
+
+  if (!TT.owns(tte)) // Entry of the table of a search context
+      return;
+
+  uint64_t* c = counts[pv][bucket(d)];
+
+  ++c[PROBES];
+
+  if (found)
+  {
+      ++c[HITS];
+
+      Key k = TT.debug_key(tte);
+      c[COLLISIONS] += k && k != key;
+  }
+
+  // An entry last saved for this very position that probe() did not return is
+  // one whose key no longer matches its content, that is a torn one.
+  const TTEntry* first = TT.first_entry(key);
+  for (int i = 0; i < TranspositionTable::cluster_size(); ++i)
+      if (   (!found || &first[i] != tte)
+          && first[i].depth8
+          && TT.debug_key(&first[i]) == key)
+      {
+          ++c[REJECTED];
+          break;
+      }
+}
+
+
+/// TTStats::on_save() records a TTEntry::save() call, before it happens
+
+void TTStats::on_save(Key key, const TTEntry* tte, Bound b, Depth d, bool pv) {
+
+  if (!TT.owns(tte)) // Entry of a QSearchTable or of a search context table
+      return;
+
+  Key k = TT.debug_key(tte);
+
+  if (!tte->depth8)
+      ++counts[pv][bucket(d)][NEW];
+
+  else if (k ? k == key : tte->key() == (uint16_t)key)
+      ++counts[pv][bucket(d)][UPDATES];
+
+  else
+      ++overwrites[pv][bucket(d)][b];
+}
+
+
+TTStats& TTStats::operator+=(const TTStats& s) {
+
+  for (int pv = 0; pv < 2; ++pv)
+      for (int d = 0; d < DEPTH_BUCKETS; ++d)
+      {
+          for (int i = 0; i < COUNTER_NB; ++i)
+              counts[pv][d][i] += s.counts[pv][d][i];
+
+          for (int b = 0; b < 4; ++b)
+              overwrites[pv][d][b] += s.overwrites[pv][d][b];
+      }
+
+  return *this;
+}
+
+
+/// TTStats::report() formats the counters, one line per node type and depth
+/// bucket, followed by the totals.
+
+std::string TTStats::report() const {
+
+  std::stringstream ss;
+  TTStats total;
+
+  auto line = [&](const uint64_t* c, const uint64_t* o) {
+      ss << " probes "     << c[PROBES]
+         << " hits "       << c[HITS]
+         << " hitrate "    << (c[PROBES] ? 100.0 * c[HITS] / c[PROBES] : 0.0) << "%"
+         << " misses "     << c[PROBES] - c[HITS]
+         << " collisions " << c[COLLISIONS]
+         << " rejected "   << c[REJECTED]
+         << " new "        << c[NEW]
+         << " updates "    << c[UPDATES]
+         << " overwrites none " << o[BOUND_NONE] << " upper " << o[BOUND_UPPER]
+         << " lower "      << o[BOUND_LOWER] << " exact " << o[BOUND_EXACT];
+  };
+
+  ss << std::fixed << std::setprecision(1) << "TT statistics";
+
+  for (int pv = 0; pv < 2; ++pv)
+      for (int d = 0; d < DEPTH_BUCKETS; ++d)
+      {
+          const uint64_t* c = counts[pv][d];
+          const uint64_t* o = overwrites[pv][d];
+
+          if (!c[PROBES] && !c[NEW] && !c[UPDATES] && !(o[0] | o[1] | o[2] | o[3]))
+              continue;
+
+          ss << "\n" << (pv ? "pv    " : "nonpv ")
+             << (d == 0 ? "depth <=0" : d == DEPTH_BUCKETS - 1 ? "depth >=" : "depth   ")
+             << std::setw(2) << (d ? std::to_string(d) : "");
+          line(c, o);
+
+          for (int i = 0; i < COUNTER_NB; ++i)
+              total.counts[0][0][i] += c[i];
+          for (int b = 0; b < 4; ++b)
+              total.overwrites[0][0][b] += o[b];
+      }
+
+  ss << "\ntotal";
+  line(total.counts[0][0], total.overwrites[0][0]);
+
+  return ss.str();
+}
+
+#endif
+
 } // namespace Stockfish
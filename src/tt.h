@@ -19,6 +19,10 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "misc.h"
 #include "types.h"
 
@@ -34,6 +38,13 @@ namespace Stockfish {
 /// move       16 bit
 /// value      16 bit
 /// eval value 16 bit
+///
+/// When compiled with TT_LOCKLESS the key is stored XORed with a checksum of the
+/// other fields (Hyatt's lockless hashing), so an entry torn by concurrent writers
+/// no longer matches its own key and is simply seen as a miss by probe(). Foreign
+/// entries are not detected: the entry of another position with the same key16
+/// is still a hit, as without TT_LOCKLESS, since the 10 bytes leave no room for
+/// a wider key.
 
 struct TTEntry {
 
@@ -43,10 +54,26 @@ struct TTEntry {
   Depth depth() const { return (Depth)depth8 + DEPTH_OFFSET; }
   bool is_pv()  const { return (bool)(genBound8 & 0x4); }
   Bound bound() const { return (Bound)(genBound8 & 0x3); }
-  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
+  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
 
 private:
   friend class TranspositionTable;
+  friend class QSearchTable;
+  friend struct TTStats;
+
+#if defined(TT_LOCKLESS)
+  uint16_t check16() const {
+    uint64_t data =  uint64_t(move16) | uint64_t(uint16_t(value16)) << 16
+                   | uint64_t(uint16_t(eval16)) << 32 | uint64_t(depth8) << 48
+                   | uint64_t(genBound8 & 0x7) << 56; // Generation is refreshed on probe
+    return uint16_t((data * 0x9E3779B97F4A7C15ULL) >> 48);
+  }
+  uint16_t key() const { return key16 ^ check16(); }
+  void seal(uint16_t k) { key16 = k ^ check16(); }
+#else
+  uint16_t key() const { return key16; }
+  void seal(uint16_t k) { key16 = k; }
+#endif
 
   uint16_t key16;
   uint8_t  depth8;
@@ -57,22 +84,87 @@ private:
 };
 
 
+/// TTStats holds the transposition table counters of a search thread, bucketed
+/// by depth and node type: probes, hits, key16 collisions (hits whose full key,
+/// kept aside for debugging, is another one), rejected entries (stored for the
+/// probed key but not found, i.e. torn) and saves, split in new entries, updates
+/// of the same position and overwrites of another one, by bound type. They are
+/// collected only in builds with TT_STATS, otherwise everything compiles out,
+/// and only for the global table, whose full keys are kept: the tables of the
+/// search contexts (see the "context" command) are not counted.
+
+struct TTStats {
+
+  static constexpr int DEPTH_BUCKETS = 16; // Depth <= 0 (qsearch), 1, ..., >= 15
+
+  enum Counter { PROBES, HITS, COLLISIONS, REJECTED, NEW, UPDATES, COUNTER_NB };
+
+#if defined(TT_STATS)
+  void clear() { *this = TTStats(); }
+  void on_probe(Key key, const TTEntry* tte, bool found, Depth d, bool pv);
+  void on_save(Key key, const TTEntry* tte, Bound b, Depth d, bool pv);
+  TTStats& operator+=(const TTStats& s);
+  std::string report() const;
+
+private:
+  static int bucket(Depth d) { return std::clamp(int(d), 0, DEPTH_BUCKETS - 1); }
+
+  uint64_t counts[2][DEPTH_BUCKETS][COUNTER_NB] = {};
+  uint64_t overwrites[2][DEPTH_BUCKETS][4] = {};
+#else
+  void clear() {}
+  void on_probe(Key, const TTEntry*, bool, Depth, bool) {}
+  void on_save(Key, const TTEntry*, Bound, Depth, bool) {}
+  TTStats& operator+=(const TTStats&) { return *this; }
+  std::string report() const { return "TT statistics are not compiled in, build with ttstats=yes"; }
+#endif
+};
+
+
+/// TTCluster is a group of TTEntry sharing a cache line, with the epoch of the
+/// table when it was last written (see TranspositionTable) in its padding. The
+/// default 32 bytes cluster has 3 entries, half a cache line. Building with
+/// ttcluster=64 gives a whole cache line of 6 entries instead, trading fewer
+/// clusters for more replacement choices, which may pay off with large hashes.
+
+#if !defined(TT_CLUSTER_BYTES)
+#define TT_CLUSTER_BYTES 32
+#endif
+
+template<int Bytes> struct TTCluster;
+
+template<> struct TTCluster<32> {
+  static constexpr int Size = 3;
+
+  TTEntry entry[Size];
+  uint16_t epoch16;
+};
+
+template<> struct TTCluster<64> {
+  static constexpr int Size = 6;
+
+  TTEntry entry[Size];
+  uint16_t epoch16;
+  uint16_t padding;
+};
+
+
 /// A TranspositionTable is an array of Cluster, of size clusterCount. Each
 /// cluster consists of ClusterSize number of TTEntry. Each non-empty TTEntry
 /// contains information on exactly one position. The size of a Cluster should
 /// divide the size of a cache line for best performance, as the cacheline is
 /// prefetched when possible.
+///
+/// Clearing the table only bumps its epoch: a cluster stamped with an older
+/// epoch is stale, and is zeroed by probe() the first time it is accessed.
 
 class TranspositionTable {
 
-  static constexpr int ClusterSize = 3;
+  typedef TTCluster<TT_CLUSTER_BYTES> Cluster;
 
-  struct Cluster {
-    TTEntry entry[ClusterSize];
-    char padding[2]; // Pad to 32 bytes
-  };
+  static constexpr int ClusterSize = Cluster::Size;
 
-  static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
+  static_assert(sizeof(Cluster) == TT_CLUSTER_BYTES, "Unexpected Cluster size");
 
   // Constants used to refresh the hash table periodically
   static constexpr unsigned GENERATION_BITS  = 3;                                // nb of bits reserved for other things
@@ -80,28 +172,108 @@ class TranspositionTable {
   static constexpr int      GENERATION_CYCLE = 255 + (1 << GENERATION_BITS);     // cycle length
   static constexpr int      GENERATION_MASK  = (0xFF << GENERATION_BITS) & 0xFF; // mask to pull out generation number
 
+  // The hash file starts with a page sized header, so that the clusters that
+  // follow it can be mapped directly into memory.
+  static constexpr size_t FileHeaderSize = 4096;
+
+  struct FileHeader {
+    char     magic[8];
+    uint64_t clusterCount;
+    uint32_t clusterBytes;
+    uint32_t sealed;       // Entries keys are checksummed (TT_LOCKLESS)
+    uint8_t  generation8;
+  };
+
+  // Header of a table shared between processes, at the start of the segment
+  struct SharedHeader;
+
+  static void free_table(Cluster* mem, size_t mapped, SharedHeader* sh);
+  void migrate(const Cluster* from, size_t fromCount);
+  void zero();
+  bool attach(const std::string& name, size_t mbSize);
+
 public:
- ~TranspositionTable() { aligned_large_pages_free(table); }
-  void new_search() { generation8 += GENERATION_DELTA; } // Lower bits are used for other things
+ ~TranspositionTable() { free_table(table, mappedSize, shared); }
+  void new_search();
+  uint8_t generation() const { return generation8; }
   TTEntry* probe(const Key key, bool& found) const;
   int hashfull() const;
   void resize(size_t mbSize);
   void clear();
+  bool save(const std::string& fname, Depth minDepth) const;
+  bool load(const std::string& fname);
+  double remote_ratio(int node) const { return Numa::remote_ratio(table, clusterCount * sizeof(Cluster), node); }
 
   TTEntry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
   }
 
+#if defined(TT_STATS)
+  // Full key of the position last saved in the entry, 0 if unknown
+  Key debug_key(const TTEntry* tte) const { return debugKeys[entry_index(tte)]; }
+  static constexpr int cluster_size() { return ClusterSize; }
+
+  // Whether the entry is in this table, and not in a QSearchTable
+  bool owns(const TTEntry* tte) const {
+    return  reinterpret_cast<uintptr_t>(tte) - reinterpret_cast<uintptr_t>(table)
+          < clusterCount * sizeof(Cluster);
+  }
+#endif
+
 private:
   friend struct TTEntry;
 
-  size_t clusterCount;
-  Cluster* table;
-  uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+#if defined(TT_STATS)
+  size_t entry_index(const TTEntry* tte) const {
+    size_t c = size_t(reinterpret_cast<const char*>(tte) - reinterpret_cast<const char*>(table)) / sizeof(Cluster);
+    return c * ClusterSize + size_t(tte - &table[c].entry[0]);
+  }
+
+  std::vector<Key> debugKeys;
+#endif
+
+  size_t clusterCount = 0;
+  size_t mappedSize = 0; // Non zero if the table is mapped from a file
+  SharedHeader* shared = nullptr;
+  Cluster* table = nullptr;
+  uint8_t generation8 = 0; // Size must be not bigger than TTEntry::genBound8
+  uint16_t epoch16 = 0;
 };
 
 extern TranspositionTable TT;
 
+
+/// QSearchTable is a small per-thread table for the entries of the quiescence
+/// search, sized by the QSearchHash option to stay in the L2 cache while the
+/// main table is in DRAM. It is direct mapped, an entry for another position
+/// is simply overwritten. Disabled (the default) it has no entries and probe()
+/// always misses. The counters tell how many main table lookups it saves.
+
+class QSearchTable {
+
+public:
+  void resize(size_t kbSize);
+  void clear();
+
+  TTEntry* probe(const Key key, bool& found) {
+
+    if (entries.empty())
+        return found = false, nullptr;
+
+    TTEntry* tte = &entries[mul_hi64(key, entries.size())];
+
+    found = tte->key() == (uint16_t)key && tte->depth8;
+    ++probes;
+    hits += found;
+    return tte;
+  }
+
+  uint64_t probes, hits, mainHits; // mainHits: found in TT after a miss here
+
+private:
+  std::vector<TTEntry> entries;
+};
+
 } // namespace Stockfish
 
 #endif // #ifndef TT_H_INCLUDED
@@ -35,6 +35,9 @@
 ///
 /// -DUSE_PEXT    | Add runtime support for use of pext asm-instruction. Works
 ///               | only in 64-bit mode and requires hardware with pext support.
+///
+/// Runtime dispatch (-DUSE_DISPATCH, ARCH=x86-64-dispatch) needs the Makefile,
+/// as the NNUE code is compiled once per instruction set with NNUE_ARCH set.
 
 #include <cassert>
 #include <cctype>
@@ -79,10 +82,23 @@
 #if defined(USE_PEXT)
 #  include <immintrin.h> // Header for _pext_u64() intrinsic
 #  define pext(b, m) _pext_u64(b, m)
+#elif defined(USE_DISPATCH)
+#  define pext(b, m) pext_asm(b, m)
 #else
 #  define pext(b, m) 0
 #endif
 
+/// With runtime dispatch each copy of the NNUE code lives in an inline namespace
+/// named after its instruction set, so that the copies do not clash at link time
+/// while the rest of the code keeps naming them as before.
+#if defined(NNUE_ARCH)
+#  define NNUE_ARCH_BEGIN inline namespace NNUE_ARCH {
+#  define NNUE_ARCH_END }
+#else
+#  define NNUE_ARCH_BEGIN
+#  define NNUE_ARCH_END
+#endif
+
 namespace Stockfish {
 
 #ifdef USE_POPCNT
@@ -93,6 +109,16 @@ constexpr bool HasPopCnt = false;
 
 #ifdef USE_PEXT
 constexpr bool HasPext = true;
+#elif defined(USE_DISPATCH)
+extern const bool HasPext; // Decided at startup, see bitboard.cpp
+
+/// pext_asm() emits pext without compiling for BMI2, so it must only be reached
+/// when HasPext is set.
+inline uint64_t pext_asm(uint64_t b, uint64_t m) {
+  uint64_t r;
+  __asm__("pextq %2, %1, %0" : "=r"(r) : "r"(b), "rm"(m));
+  return r;
+}
 #else
 constexpr bool HasPext = false;
 #endif
@@ -16,11 +16,19 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include "evaluate.h"
 #include "movegen.h"
@@ -37,6 +45,7 @@ using namespace std;
 namespace Stockfish {
 
 extern vector<string> setup_bench(const Position&, istream&);
+extern vector<string> setup_speedtest();
 
 namespace {
 
@@ -44,12 +53,39 @@ namespace {
   const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
 
+  // The position set by the last "position" command: its FEN, the moves played
+  // from it and the key of the resulting position
+  struct LastPosition {
+    string fen;
+    vector<string> moves;
+    bool chess960;
+    Key key;
+  } lastPosition;
+
+
+  // A search context of the "context" command: a group of threads with its own
+  // hash table, position and limits. The network, the bitboard tables and the
+  // tablebase mappings are shared, being read-only during the searches.
+  struct Context {
+    ThreadPool threads;
+    TranspositionTable tt;
+    Position pos;
+    StateListPtr states;
+    LastPosition last;
+  };
+
+  map<string, unique_ptr<Context>> contexts;
+
+
   // position() is called when the engine receives the "position" UCI command.
   // It sets up the position that is described in the given FEN string ("fen") or
   // the initial position ("startpos") and then makes the moves given in the following
-  // move list ("moves").
+  // move list ("moves"). When the move list only extends the one of the current
+  // position, as GUIs send during a game, just the new moves are made, keeping
+  // the StateInfo chain of the current position.
 
-  void position(Position& pos, istringstream& is, StateListPtr& states) {
+  void position(Position& pos, istringstream& is, StateListPtr& states,
+                ThreadPool& threads = Threads, LastPosition& last = lastPosition) {
 
     Move m;
     string token, fen;
@@ -67,15 +103,44 @@ namespace {
     else
         return;
 
-    states = StateListPtr(new std::deque<StateInfo>(1)); // Drop the old state and create a new one
-    pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
+    vector<string> moves;
+    while (is >> token)
+        moves.push_back(token);
+
+    const bool chess960 = Options["UCI_Chess960"];
+    bool extends =   fen == last.fen
+                  && chess960 == last.chess960
+                  && pos.state()->key == last.key // Not changed since, by "flip" for instance
+                  && pos.this_thread() == threads.main() // Nor were the threads recreated
+                  && moves.size() >= last.moves.size()
+                  && std::equal(last.moves.begin(), last.moves.end(), moves.begin());
+
+    // The chain is handed over to the threads by "go", take it back if the
+    // search is over, else replay the moves. The UCI position still points to
+    // its last state.
+    if (extends && !states)
+    {
+        states = threads.take_setup_states();
+        extends = bool(states);
+    }
+
+    size_t played = extends ? last.moves.size() : 0;
+
+    if (!extends)
+    {
+        states = StateListPtr(new std::deque<StateInfo>(1)); // Drop the old state and create a new one
+        pos.set(fen, chess960, &states->back(), threads.main());
+    }
 
     // Parse the move list, if any
-    while (is >> token && (m = UCI::to_move(pos, token)) != MOVE_NONE)
+    for ( ; played < moves.size() && (m = UCI::to_move(pos, moves[played])) != MOVE_NONE; ++played)
     {
         states->emplace_back();
         pos.do_move(m, states->back());
     }
+
+    moves.resize(played);
+    last = { fen, moves, chess960, pos.state()->key };
   }
 
   // trace_eval() prints the evaluation of the current position, consistent with
@@ -83,22 +148,28 @@ namespace {
 
   void trace_eval(Position& pos) {
 
+    // Borrow the accumulators and caches of the main thread, once it is idle
+    Threads.main()->wait_for_search_finished();
+
     StateListPtr states(new std::deque<StateInfo>(1));
     Position p;
     p.set(pos.fen(), Options["UCI_Chess960"], &states->back(), Threads.main());
 
+    states->back().accumulator = &Threads.main()->accumulators[0];
+    states->back().accumulator->computed[WHITE] = states->back().accumulator->computed[BLACK] = false;
+
     Eval::NNUE::verify();
 
     sync_cout << "\n" << Eval::trace(p) << sync_endl;
   }
 
 
-  // setoption() is called when the engine receives the "setoption" UCI command.
-  // The function updates the UCI option ("name") to the given value ("value").
+  // read_option() reads the "name <name> value <value>" arguments of the
+  // "setoption" command, the name and the value can both contain spaces.
 
-  void setoption(istringstream& is) {
+  void read_option(istream& is, string& name, string& value) {
 
-    string token, name, value;
+    string token;
 
     is >> token; // Consume the "name" token
 
@@ -109,6 +180,17 @@ namespace {
     // Read the option value (can contain spaces)
     while (is >> token)
         value += (value.empty() ? "" : " ") + token;
+  }
+
+
+  // setoption() is called when the engine receives the "setoption" UCI command.
+  // The function updates the UCI option ("name") to the given value ("value").
+
+  void setoption(istringstream& is) {
+
+    string name, value;
+
+    read_option(is, name, value);
 
     if (Options.count(name))
         Options[name] = value;
@@ -121,7 +203,7 @@ namespace {
   // sets the thinking time and other parameters from the input string, then starts
   // with a search.
 
-  void go(Position& pos, istringstream& is, StateListPtr& states) {
+  void go(Position& pos, istringstream& is, StateListPtr& states, ThreadPool& threads = Threads) {
 
     Search::LimitsType limits;
     string token;
@@ -147,7 +229,14 @@ namespace {
         else if (token == "infinite")  limits.infinite = 1;
         else if (token == "ponder")    ponderMode = true;
 
-    Threads.start_thinking(pos, states, limits, ponderMode);
+    // Perft counts in tables of its own, which only the global threads use
+    if (limits.perft && &threads != &Threads)
+    {
+        sync_cout << threads.prefix << "info string Perft is not supported in a context" << sync_endl;
+        return;
+    }
+
+    threads.start_thinking(pos, states, limits, ponderMode);
   }
 
 
@@ -195,6 +284,704 @@ namespace {
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+    if (!(Options["NumaPolicy"] == "none"))
+        cerr << Threads.numa_info() << endl;
+
+    if (Options["QSearchHash"])
+        cerr << Threads.qsearch_stats() << endl;
+
+    if (Options["EvalCache"])
+        cerr << Threads.eval_cache_stats() << endl;
+
+    string accStats = Threads.accumulator_stats(nodes);
+    if (!accStats.empty())
+        cerr << accStats << endl;
+
+    if (Options["PerfCounters"])
+        cerr << Threads.perf_stats(false, nodes) << endl;
+
+#if defined(TT_STATS)
+    cerr << "\n" << Threads.tt_stats() << endl;
+#endif
+  }
+
+  // to_size() sets 'n' to the decimal number 'str' and returns true, or returns
+  // false if 'str' is not one, made of at most 9 digits and nothing else.
+
+  bool to_size(const string& str, size_t& n) {
+
+    if (str.empty() || str.size() > 9 || str.find_first_not_of("0123456789") != string::npos)
+        return false;
+
+    n = size_t(stoul(str));
+    return true;
+  }
+
+  // speedtest() is called when the engine receives the "speedtest" command.
+  // It plays through a game, searching each of its positions for 'movetime'
+  // (default 250) ms, once for each combination of 'threads' (default 1, 2,
+  // 4... up to the number of hardware threads) and 'hash' (default the Hash
+  // option), both comma separated lists. For each configuration it prints on
+  // stdout one line with the nodes per second, the speedup over the first
+  // thread count with the same hash, the hashfull at the end of the game and
+  // the average time in ms to complete each depth reached in every position.
+
+  void speedtest(Position& pos, istream& args, StateListPtr& states) {
+
+    // Each item of the list must be a positive number, else the list is invalid
+    auto parse_list = [](const string& str, vector<size_t>& list) {
+        istringstream ss(str);
+        string item;
+        size_t n;
+        while (getline(ss, item, ','))
+            if (!to_size(item, n) || !n)
+                return false;
+            else
+                list.push_back(n);
+        return true;
+    };
+
+    const size_t threads = size_t(Options["Threads"]), hash = size_t(Options["Hash"]);
+    string threadsList, hashList;
+    TimePoint movetime = 250;
+
+    args >> threadsList >> hashList >> movetime;
+
+    vector<size_t> threadCounts, hashSizes;
+
+    if (!parse_list(threadsList, threadCounts) || !parse_list(hashList, hashSizes))
+    {
+        sync_cout << "info string Invalid speedtest list, expected comma separated"
+                     " positive numbers" << sync_endl;
+        return;
+    }
+
+    if (threadCounts.empty())
+    {
+        size_t maxThreads = max(size_t(std::thread::hardware_concurrency()), size_t(1));
+        for (size_t n = 1; n <= maxThreads; n = n < maxThreads ? min(2 * n, maxThreads) : n + 1)
+            threadCounts.push_back(n);
+    }
+
+    if (hashSizes.empty())
+        hashSizes.push_back(hash);
+
+    vector<string> list = setup_speedtest();
+    Search::LimitsType limits;
+    limits.movetime = max(movetime, TimePoint(1));
+
+    for (size_t hashMB : hashSizes)
+    {
+        double baseNps = 0;
+
+        for (size_t n : threadCounts)
+        {
+            Options["Hash"] = to_string(hashMB);
+            Options["Threads"] = to_string(n);
+            Search::clear();
+
+            uint64_t nodes = 0;
+            TimePoint elapsed = 0;
+            size_t positions = 0;
+            int64_t depthSum = 0;
+            vector<int64_t> ttdSum(MAX_PLY, 0), ttdCnt(MAX_PLY, 0);
+
+            streambuf* buf = cout.rdbuf(nullptr); // Silence the search output
+
+            for (const auto& cmd : list)
+            {
+                istringstream is(cmd);
+                string token;
+                is >> skipws >> token;
+                position(pos, is, states);
+
+                limits.startTime = now();
+                Threads.start_thinking(pos, states, limits);
+                Threads.main()->wait_for_search_finished();
+                elapsed += now() - limits.startTime;
+                nodes += Threads.nodes_searched();
+
+                Depth completed = Threads.main()->completedDepth;
+                depthSum += completed;
+                for (Depth d = 1; d <= completed; ++d)
+                {
+                    ttdSum[d] += Threads.main()->depthTime[d];
+                    ttdCnt[d]++;
+                }
+
+                ++positions;
+                cerr << "\rThreads " << n << ", hash " << hashMB << " MB: "
+                     << positions << '/' << list.size() << flush;
+            }
+
+            cout.rdbuf(buf);
+            cerr << endl;
+
+            elapsed = max(elapsed, TimePoint(1)); // Avoid a 'divide by zero'
+            double nps = 1000.0 * nodes / elapsed;
+            baseNps = baseNps ? baseNps : nps;
+
+            ostringstream ss;
+            ss << "speedtest threads " << n << " hash " << hashMB
+               << " movetime " << limits.movetime << " positions " << positions
+               << " nodes " << nodes << " time " << elapsed
+               << " nps " << uint64_t(nps)
+               << fixed << setprecision(2) << " speedup " << nps / max(baseNps, 1.0)
+               << " hashfull " << TT.hashfull()
+               << " depth " << double(depthSum) / max(positions, size_t(1))
+               << " ttd";
+
+            for (Depth d = 1; d < MAX_PLY && ttdCnt[d] == int64_t(positions); ++d)
+                ss << ' ' << d << ':' << ttdSum[d] / ttdCnt[d];
+
+            sync_cout << ss.str() << sync_endl;
+        }
+    }
+
+    Options["Hash"] = to_string(hash);
+    Options["Threads"] = to_string(threads);
+  }
+
+  // batch() is called when the engine receives the "batch" command. It reads
+  // positions, one FEN or EPD per line, from 'file' ("-" for stdin) as they
+  // come, up to its end or an "end" line, and searches 'groups' of them at the same time, each group with its
+  // own pool of 'threads' (default 1) threads. The groups default to as many
+  // as the Threads option allows. Each search is limited by 'depth' (default
+  // 13), 'nodes' or 'movetime', and reported on stdout as one line, tagged with
+  // the number of its input line since the searches finish in any order.
+
+  void batch(istream& args) {
+
+    Search::LimitsType limits;
+    string token, fileName;
+    size_t threads = 1, groups = 0;
+
+    while (args >> token)
+        if (token == "depth")         args >> limits.depth;
+        else if (token == "nodes")    args >> limits.nodes;
+        else if (token == "movetime") args >> limits.movetime;
+        else if (token == "threads")  args >> threads;
+        else if (token == "groups")   args >> groups;
+        else if (token == "file")     args >> fileName;
+
+    if (!limits.depth && !limits.nodes && !limits.movetime)
+        limits.depth = 13;
+
+    threads = std::clamp(threads, size_t(1), size_t(512));
+    groups = std::clamp(groups ? groups : size_t(Options["Threads"]) / threads, size_t(1), size_t(512));
+
+    if (fileName.empty())
+    {
+        sync_cout << "info string batch needs a file, or 'file -' to read stdin" << sync_endl;
+        return;
+    }
+
+    ifstream file;
+    if (fileName != "-")
+    {
+        file.open(fileName);
+        if (!file.is_open())
+        {
+            cerr << "Unable to open file " << fileName << endl;
+            return;
+        }
+    }
+    istream& in = fileName == "-" ? cin : file;
+
+    Eval::NNUE::verify();
+    TT.new_search();
+
+    vector<unique_ptr<ThreadPool>> pools;
+
+    for (size_t g = 0; g < groups; ++g)
+    {
+        pools.emplace_back(make_unique<ThreadPool>());
+        pools.back()->quiet = true;
+        pools.back()->bindBase = g * threads;
+        pools.back()->set(threads);
+    }
+
+    mutex inMutex;
+    uint64_t lineNo = 0, positions = 0, totalNodes = 0;
+    bool done = false;
+    TimePoint elapsed = now();
+
+    // Each group takes the next position once done with the previous one
+    auto run = [&](ThreadPool& pool) {
+
+        string line;
+
+        while (true)
+        {
+            uint64_t n;
+            {
+                lock_guard<mutex> lk(inMutex);
+
+                do
+                {
+                    // Stop at an "end" line, so that the UCI loop gets the rest of stdin
+                    if (   done
+                        || !getline(in, line)
+                        || line.substr(0, line.find_last_not_of(" \t\r") + 1) == "end")
+                    {
+                        done = true;
+                        return;
+                    }
+                    ++lineNo;
+                } while (line.find_first_not_of(" \t\r") == string::npos);
+
+                n = lineNo;
+            }
+
+            // An EPD has no move counters but operations after the 4 FEN fields
+            istringstream ls(line);
+            string fen, field;
+            for (int i = 0; i < 6 && ls >> field; ++i)
+            {
+                if (i >= 4 && field.find_first_not_of("0123456789") != string::npos)
+                    break;
+                fen += (i ? " " : "") + field;
+            }
+
+            StateListPtr states(new std::deque<StateInfo>(1));
+            Position pos;
+            pos.set(fen, Options["UCI_Chess960"], &states->back(), pool.main());
+
+            Search::LimitsType lim = limits;
+            lim.startTime = now();
+            pool.start_thinking(pos, states, lim);
+            pool.main()->wait_for_search_finished();
+
+            const Thread* best = pool.lastBestThread;
+            const Search::RootMove& rm = best->rootMoves[0];
+            uint64_t nodes = pool.nodes_searched();
+
+            Value v =  rm.pv[0] == MOVE_NONE     ? (pos.checkers() ? -VALUE_MATE : VALUE_DRAW)
+                     : rm.score != -VALUE_INFINITE ? rm.score : rm.previousScore;
+
+            if (pool.tbConfig.rootInTB && abs(v) < VALUE_MATE_IN_MAX_PLY)
+                v = rm.tbScore;
+
+            ostringstream ss;
+            ss << "line " << n
+               << " bestmove " << UCI::move(rm.pv[0], pos.is_chess960())
+               << " score "    << UCI::value(v)
+               << " depth "    << best->completedDepth
+               << " nodes "    << nodes
+               << " time "     << now() - lim.startTime
+               << " pv";
+
+            for (Move m : rm.pv)
+                ss << " " << UCI::move(m, pos.is_chess960());
+
+            sync_cout << ss.str() << sync_endl;
+
+            lock_guard<mutex> lk(inMutex);
+            ++positions;
+            totalNodes += nodes;
+        }
+    };
+
+    vector<std::thread> drivers;
+    for (auto& pool : pools)
+        drivers.emplace_back(run, std::ref(*pool));
+
+    for (std::thread& t : drivers)
+        t.join();
+
+    for (auto& pool : pools)
+        pool->set(0);
+
+    elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    cerr << "\n==========================="
+         << "\nGroups x threads : " << groups << " x " << threads
+         << "\nPositions        : " << positions
+         << "\nTotal time (ms)  : " << elapsed
+         << "\nNodes searched   : " << totalNodes
+         << "\nNodes/second     : " << 1000 * totalNodes / elapsed
+         << "\nPositions/second : " << fixed << setprecision(1) << 1000.0 * positions / elapsed << endl;
+  }
+
+  // context() is called when the engine receives the "context" command, which
+  // multiplexes independent searches, of concurrent games for instance, in one
+  // process. "context <id> open [threads N] [hash MB]" makes a search context,
+  // then "context <id> <command>" runs one of the UCI commands position, go,
+  // stop, ponderhit, ucinewgame, isready and setoption (Threads and Hash only,
+  // the other options are shared) in it, until "context <id> close". The output
+  // of a context is prefixed with "context <id> ".
+
+  void context(istringstream& is) {
+
+    string id, token;
+    is >> id >> token;
+
+    auto it = contexts.find(id);
+
+    if (token == "open")
+    {
+        if (it != contexts.end())
+        {
+            sync_cout << "info string Context " << id << " is already open" << sync_endl;
+            return;
+        }
+
+        size_t threads = 1, hash = size_t(Options["Hash"]);
+        string value;
+
+        while (is >> token)
+            if (   (token == "threads" && !(is >> value && to_size(value, threads)))
+                || (token == "hash"    && !(is >> value && to_size(value, hash))))
+            {
+                sync_cout << "info string Invalid " << token << " for context " << id << sync_endl;
+                return;
+            }
+
+        // Bind the threads after those of the global pool and of the other contexts
+        size_t bindBase = Threads.size();
+        for (const auto& c : contexts)
+            bindBase += c.second->threads.size();
+
+        Eval::NNUE::verify();
+
+        auto ctx = make_unique<Context>();
+        ctx->threads.prefix = "context " + id + " ";
+        ctx->threads.bindBase = bindBase;
+        ctx->threads.tt = &ctx->tt;
+        ctx->threads.set(std::clamp(threads, size_t(1), size_t(1024)));
+        ctx->tt.resize(std::clamp(hash, size_t(1), size_t(UCI::MaxHashMB)));
+        ctx->states = StateListPtr(new std::deque<StateInfo>(1));
+        ctx->pos.set(StartFEN, false, &ctx->states->back(), ctx->threads.main());
+        contexts[id] = std::move(ctx);
+        return;
+    }
+
+    if (it == contexts.end())
+    {
+        sync_cout << "info string No such context: " << id << sync_endl;
+        return;
+    }
+
+    Context& ctx = *it->second;
+    ThreadPool& threads = ctx.threads;
+
+    if (token == "stop")
+        threads.stop = true;
+
+    else if (token == "ponderhit")
+        threads.main()->ponder = false; // Switch to the normal search
+
+    else if (token == "go")         go(ctx.pos, is, ctx.states, threads);
+    else if (token == "position")   position(ctx.pos, is, ctx.states, threads, ctx.last);
+    else if (token == "isready")    sync_cout << threads.prefix << "readyok" << sync_endl;
+    else if (token == "ucinewgame")
+    {
+        threads.main()->wait_for_search_finished();
+        threads.time.availableNodes = 0;
+        ctx.tt.clear();
+        threads.clear();
+    }
+    else if (token == "setoption")
+    {
+        string name, value;
+        size_t n;
+
+        read_option(is, name, value);
+
+        if (name != "Threads" && name != "Hash")
+            sync_cout << threads.prefix << "info string Option " << name
+                      << " is shared, set it with setoption" << sync_endl;
+
+        else if (!to_size(value, n))
+            sync_cout << threads.prefix << "info string Invalid value '" << value
+                      << "' for option " << name << sync_endl;
+
+        // Out of range values are clamped to the bounds of the global options
+        else if (name == "Threads")
+            threads.set(std::clamp(n, size_t(1), size_t(1024)));
+
+        else
+        {
+            threads.main()->wait_for_search_finished();
+            ctx.tt.resize(std::clamp(n, size_t(1), size_t(UCI::MaxHashMB)));
+        }
+    }
+    else if (token == "close")
+    {
+        threads.stop = true;
+        threads.set(0);
+        contexts.erase(it);
+    }
+    else
+        sync_cout << "Unknown context command: '" << token << "'" << sync_endl;
+  }
+
+  // nnue_bench() is called when the engine receives the "nnuebench" command.
+  // It evaluates each of the default bench positions 'iterations' (default
+  // 10000) times with the NNUE network and reports the evaluations per second
+  // and the share of non-zero 4-byte blocks in the input of the first layer.
+
+  void nnue_bench(Position& pos, istream& args, StateListPtr& states) {
+
+    int iterations = 10000;
+    args >> iterations;
+
+    istringstream benchArgs("16 1 1 default depth NNUE");
+    vector<string> list = setup_bench(pos, benchArgs);
+
+    Eval::NNUE::verify();
+
+    // The accumulators of the main thread are borrowed below, once it is idle
+    Threads.main()->wait_for_search_finished();
+
+    Eval::NNUE::BenchmarkStats stats{};
+    int positions = 0;
+
+    for (const auto& cmd : list)
+    {
+        istringstream is(cmd);
+        string token;
+        is >> skipws >> token;
+
+        if (token == "setoption")
+            setoption(is);
+
+        else if (token == "position")
+        {
+            position(pos, is, states);
+
+            StateListPtr st(new std::deque<StateInfo>(1));
+            Position p;
+            p.set(pos.fen(), Options["UCI_Chess960"], &st->back(), Threads.main());
+
+            st->back().accumulator = &Threads.main()->accumulators[0];
+            st->back().accumulator->computed[WHITE] = st->back().accumulator->computed[BLACK] = false;
+
+            Eval::NNUE::benchmark(p, iterations, stats);
+            ++positions;
+        }
+    }
+
+    cerr << "\n==========================="
+         << "\nPositions              : " << positions
+         << "\nEvaluations            : " << stats.evaluations
+         << "\nEvaluations/second     : " << stats.evaluations * 1000000000 / max(stats.nanoseconds, uint64_t(1))
+         << "\nNon-zero input blocks  : " << fixed << setprecision(1)
+         << 100.0 * stats.nonZeroBlocks / max(stats.blocks, uint64_t(1)) << "% ("
+         << stats.nonZeroBlocks << " of " << stats.blocks << ")" << endl;
+  }
+
+  // eval_batch() is called when the engine receives the "evalbatch" command.
+  // It prints one per line the NNUE evaluation, from the side to move, of the
+  // positions of 'fenFile' (one FEN per line, default the bench positions).
+  // They are evaluated 'batchSize' (default 32) positions at a time, a batch
+  // size of 1 using the per-position evaluation. The throughput, overall and
+  // of the evaluation calls alone, is reported on stderr at the end.
+
+  void eval_batch(Position& pos, istream& args, StateListPtr& states) {
+
+    size_t batchSize = 32;
+    string token, fenFile = "default";
+    args >> batchSize >> fenFile;
+    batchSize = std::clamp(batchSize, size_t(1), size_t(65536));
+
+    vector<pair<string, bool>> fens; // FEN and whether it is Chess960
+
+    if (fenFile == "default")
+    {
+        istringstream benchArgs("16 1 1 default depth NNUE");
+        for (const auto& cmd : setup_bench(pos, benchArgs))
+        {
+            istringstream is(cmd);
+            is >> skipws >> token;
+
+            if (token == "setoption")
+                setoption(is);
+
+            else if (token == "position")
+            {
+                position(pos, is, states);
+                fens.emplace_back(pos.fen(), pos.is_chess960());
+            }
+        }
+    }
+    else
+    {
+        ifstream file(fenFile);
+        string fen;
+
+        while (getline(file, fen))
+            if (!fen.empty())
+                fens.emplace_back(fen, bool(Options["UCI_Chess960"]));
+
+        if (fens.empty())
+        {
+            cerr << "No positions in " << fenFile << endl;
+            return;
+        }
+    }
+
+    Eval::NNUE::verify();
+
+    vector<StateInfo> st(batchSize);
+    vector<Eval::NNUE::Accumulator> accumulators(batchSize);
+    unique_ptr<Position[]> positions(new Position[batchSize]);
+    vector<const Position*> batch(batchSize);
+    vector<Value> values(batchSize);
+
+    chrono::steady_clock::duration evalTime{};
+    TimePoint elapsed = now();
+
+    for (size_t start = 0; start < fens.size(); start += batchSize)
+    {
+        size_t n = min(batchSize, fens.size() - start);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            positions[i].set(fens[start + i].first, fens[start + i].second, &st[i], Threads.main());
+            st[i].accumulator = &accumulators[i];
+            accumulators[i].computed[WHITE] = accumulators[i].computed[BLACK] = false;
+            batch[i] = &positions[i];
+        }
+
+        auto evalStart = chrono::steady_clock::now();
+
+        if (batchSize == 1)
+            values[0] = Eval::NNUE::evaluate(positions[0]);
+        else
+            Eval::NNUE::evaluate(batch.data(), n, values.data());
+
+        evalTime += chrono::steady_clock::now() - evalStart;
+
+        string out;
+        for (size_t i = 0; i < n; ++i)
+            out += UCI::value(values[i]) + "\n";
+        cout << out;
+    }
+
+    cout << flush;
+
+    elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+    int64_t evalNs = chrono::duration_cast<chrono::nanoseconds>(evalTime).count() + 1;
+
+    cerr << "\n==========================="
+         << "\nPositions              : " << fens.size()
+         << "\nBatch size             : " << batchSize
+         << "\nTotal time (ms)        : " << elapsed
+         << "\nEvaluation time (ms)   : " << evalNs / 1000000
+         << "\nEvaluations/second     : " << 1000 * fens.size() / elapsed
+         << "\nEval calls only        : " << 1000000000 * fens.size() / evalNs << "/second" << endl;
+  }
+
+  // nnue_layers() is called when the engine receives the "nnuelayers" command.
+  // It times each kernel of the NNUE evaluation on its own, 'iterations'
+  // (default 1000) times on each input it gets from the default bench positions,
+  // for each SIMD code compiled in that the CPU can run. Cycles are those of
+  // the time stamp counter, 0 when not available.
+
+  void nnue_layers(Position& pos, istream& args, StateListPtr& states) {
+
+    int iterations = 1000;
+    args >> iterations;
+    iterations = std::max(iterations, 1);
+
+    istringstream benchArgs("16 1 1 default depth NNUE");
+    vector<string> fens;
+    string token;
+
+    for (const auto& cmd : setup_bench(pos, benchArgs))
+    {
+        istringstream is(cmd);
+        is >> skipws >> token;
+
+        if (token == "setoption")
+            setoption(is);
+
+        else if (token == "position")
+        {
+            position(pos, is, states);
+            fens.push_back(pos.fen());
+        }
+    }
+
+    Eval::NNUE::verify();
+
+    for (const auto& [arch, layers] : Eval::NNUE::benchmark_layers(fens, iterations))
+    {
+        cerr << "\n==========================="
+             << "\nNNUE kernels, " << arch << ", " << fens.size() << " positions\n\n"
+             << left << setw(44) << "Kernel" << right
+             << setw(10) << "Calls" << setw(10) << "ns/call" << setw(13) << "cycles/call"
+             << setw(12) << "bytes/call" << setw(8) << "GB/s" << "\n";
+
+        for (const auto& l : layers)
+        {
+            double calls = double(max(l.calls, uint64_t(1)));
+
+            cerr << left << setw(44) << l.name << right << fixed
+                 << setw(10) << l.calls
+                 << setw(10) << setprecision(1) << l.nanoseconds / calls
+                 << setw(13) << setprecision(1) << l.cycles / calls
+                 << setw(12) << setprecision(0) << l.bytes / calls
+                 << setw(8)  << setprecision(1) << double(l.bytes) / max(l.nanoseconds, uint64_t(1)) << "\n";
+        }
+    }
+
+    cerr << endl;
+  }
+
+  // wakeup() measures the latency of waking up the threads for a search, with
+  // the current Wakeup Spin, for 1, 2, 4... up to maxThreads threads (default
+  // the Threads option). Each of the 'iterations' (default 1000) searches of
+  // the current position is to depth 1, so it is mostly made of wakeups. It
+  // reports the average time from 'go' until the last thread started to search
+  // and until the search is over, in microseconds.
+
+  void wakeup(Position& pos, istream& is, StateListPtr& states) {
+
+    using namespace std::chrono;
+
+    const size_t threads = size_t(Options["Threads"]);
+    size_t maxThreads = threads, iterations = 1000;
+
+    is >> maxThreads >> iterations;
+
+    Search::LimitsType limits;
+    limits.depth = 1;
+
+    for (size_t n = 1; n <= maxThreads; n = n < maxThreads ? min(2 * n, maxThreads) : n + 1)
+    {
+        Options["Threads"] = to_string(n);
+
+        int64_t started = 0, finished = 0;
+
+        streambuf* buf = cout.rdbuf(nullptr); // Silence the search output
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            limits.startTime = now();
+            auto go = steady_clock::now();
+
+            Threads.start_thinking(pos, states, limits);
+            Threads.main()->wait_for_search_finished();
+
+            auto done = steady_clock::now(), last = go;
+            for (Thread* th : Threads)
+                last = max(last, th->wakeTime);
+
+            started  += duration_cast<nanoseconds>(last - go).count();
+            finished += duration_cast<nanoseconds>(done - go).count();
+        }
+
+        cout.rdbuf(buf);
+
+        cerr << "Threads " << setw(3) << n
+             << "  go to last thread start " << setw(8) << started / 1000 / int64_t(iterations) << " us"
+             << "  go to search done "       << setw(8) << finished / 1000 / int64_t(iterations) << " us" << endl;
+    }
+
+    Options["Threads"] = to_string(threads);
   }
 
   // The win rate model returns the probability of winning (in per mille units) given an
@@ -274,9 +1061,18 @@ void UCI::loop(int argc, char* argv[]) {
       // These commands must not be used during a search!
       else if (token == "flip")     pos.flip();
       else if (token == "bench")    bench(pos, is, states);
+      else if (token == "wakeup")   wakeup(pos, is, states);
+      else if (token == "speedtest") speedtest(pos, is, states);
+      else if (token == "batch")    batch(is);
+      else if (token == "context")  context(is);
+      else if (token == "nnuebench") nnue_bench(pos, is, states);
+      else if (token == "evalbatch") eval_batch(pos, is, states);
+      else if (token == "nnuelayers") nnue_layers(pos, is, states);
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     trace_eval(pos);
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "ttstats")  sync_cout << Threads.tt_stats() << "\n"
+                                              << Threads.qsearch_stats() << sync_endl;
       else if (token == "export_net")
       {
           std::optional<std::string> filename;
@@ -285,6 +1081,25 @@ void UCI::loop(int argc, char* argv[]) {
               filename = f;
           Eval::NNUE::save_eval(filename);
       }
+      else if (token == "export_net_image")
+      {
+          std::string f;
+          if (is >> skipws >> f)
+              Eval::NNUE::save_image(f);
+          else
+              sync_cout << "Usage: export_net_image <filename>" << sync_endl;
+      }
+      else if (token == "save_hash" || token == "load_hash")
+      {
+          std::string f;
+          int minDepth;
+          if (!(is >> skipws >> f))
+              sync_cout << "No file name given" << sync_endl;
+          else if (token == "load_hash")
+              TT.load(f);
+          else
+              TT.save(f, is >> minDepth ? Depth(minDepth) : DEPTH_NONE); // By default keep all entries
+      }
       else if (token == "--help" || token == "help" || token == "--license" || token == "license")
           sync_cout << "\nStockfish is a powerful chess engine for playing and analyzing."
                        "\nIt is released as free software licensed under the GNU GPLv3 License."
@@ -296,6 +1111,15 @@ void UCI::loop(int argc, char* argv[]) {
           sync_cout << "Unknown command: '" << cmd << "'. Type help for more information." << sync_endl;
 
   } while (token != "quit" && argc == 1); // The command-line arguments are one-shot
+
+  // Stop the searches of the contexts and free them, before the global threads
+  for (auto& c : contexts)
+      c.second->threads.stop = true;
+
+  for (auto& c : contexts)
+      c.second->threads.set(0);
+
+  contexts.clear();
 }
 
 
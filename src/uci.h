@@ -67,6 +67,9 @@ private:
   OnChange on_change;
 };
 
+/// The largest Hash, in MB, of the global table and of the context ones
+constexpr int MaxHashMB = Is64Bit ? 33554432 : 2048;
+
 void init(OptionsMap&);
 void loop(int argc, char* argv[]);
 std::string value(Value v);
@@ -40,8 +40,25 @@ namespace UCI {
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
+void on_shared_hash(const Option&) { TT.resize(size_t(Options["Hash"])); }
+void on_qsearch_hash(const Option& o) {
+  Threads.main()->wait_for_search_finished();
+  for (Thread* th : Threads)
+      th->qsTable.resize(size_t(o));
+}
+void on_eval_cache(const Option& o) {
+  Threads.main()->wait_for_search_finished();
+  for (Thread* th : Threads)
+      th->evalCache.resize(size_t(o));
+}
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(size_t(o)); }
+void on_wakeup_spin(const Option&) { ThreadPool::update_options(); }
+void on_perf_counters(const Option&) { ThreadPool::update_options(); }
+void on_numa_policy(const Option&) {
+  Threads.set(size_t(Options["Threads"]));
+  sync_cout << "info string " << Threads.numa_info() << sync_endl;
+}
 void on_tb_path(const Option& o) { Tablebases::init(o); }
 void on_use_NNUE(const Option& ) { Eval::NNUE::init(); }
 void on_eval_file(const Option& ) { Eval::NNUE::init(); }
@@ -58,11 +75,16 @@ bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const
 
 void init(OptionsMap& o) {
 
-  constexpr int MaxHashMB = Is64Bit ? 33554432 : 2048;
-
   o["Debug Log File"]        << Option("", on_logger);
   o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["NumaPolicy"]            << Option("none var none var shard var interleave", "none", on_numa_policy);
+  o["Wakeup Spin"]           << Option(0, 0, 100000, on_wakeup_spin);
+  o["PerfCounters"]          << Option(false, on_perf_counters);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
+  o["SharedHash"]            << Option("<empty>", on_shared_hash);
+  o["QSearchHash"]           << Option(0, 0, 65536, on_qsearch_hash);
+  o["EvalCache"]             << Option(0, 0, 65536, on_eval_cache);
+  o["PerftHash"]             << Option(16, 0, MaxHashMB);
   o["Clear Hash"]            << Option(on_clear_hash);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
@@ -134,7 +156,7 @@ Option::operator double() const {
 }
 
 Option::operator std::string() const {
-  assert(type == "string");
+  assert(type == "string" || type == "combo");
   return currentValue;
 }
 
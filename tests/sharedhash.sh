@@ -0,0 +1,90 @@
+#!/bin/bash
+# compare the time and nodes to depth of processes searching the same positions
+# concurrently, each with a private hash table and then all on one SharedHash.
+# The nodes do not depend on the cores, the times only compare with at least
+# as many cores as processes.
+#
+# usage: sharedhash.sh [processes] [depth] [hash] [evalType]
+# run from the directory of the stockfish binary, like the other tests
+
+error()
+{
+  echo "sharedhash testing failed on line $1"
+  rm -f sharedhash.*.out
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+processes=${1:-4}
+depth=${2:-16}
+hash=${3:-64}
+evaltype=${4:-mixed}
+
+fens=(
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10"
+  "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19"
+  "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15"
+  "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13"
+)
+
+# search() plays the positions in one process, sending each "go" only once
+# the previous search has given its bestmove, so that the reported times are
+# those of the searches alone
+search()
+{
+  out=$2
+  n=0
+  : > $out
+  {
+    echo "setoption name Hash value $hash"
+    echo "setoption name SharedHash value $1"
+    [ "$evaltype" = classical ] && echo "setoption name Use NNUE value false"
+    for fen in "${fens[@]}"
+    do
+      echo "position fen $fen"
+      echo "go depth $depth"
+      n=$((n+1))
+      while [ "$(grep -c '^bestmove' $out)" -lt $n ]; do sleep 0.05; done
+    done
+    echo "quit"
+  } | ./stockfish > $out
+}
+
+# ttd() prints the average time, in ms, and nodes at which the searches of the
+# output files completed the requested depth
+ttd()
+{
+  awk -v d=$depth '$1 == "info" && $2 == "depth" && $3 == d {
+                     for (i = 4; i < NF; ++i)
+                       if ($i == "time") t = $(i+1); else if ($i == "nodes") c = $(i+1)
+                   }
+                   $1 == "bestmove" { time += t; nodes += c; ++n; t = c = 0 }
+                   END { printf "%d %d", n ? time / n : 0, n ? nodes / n : 0 }' "$@"
+}
+
+run()
+{
+  for p in `seq 1 $processes`
+  do
+    search "$1" sharedhash.$p.out &
+  done
+  wait
+  ttd sharedhash.*.out
+}
+
+echo "sharedhash testing started: $processes processes, depth $depth, hash $hash MB"
+
+read private_time private_nodes <<< `run "<empty>"`
+read shared_time shared_nodes <<< `run "sf-sharedhash-$$"`
+
+rm -f sharedhash.*.out
+
+gain()
+{
+  awk -v a=$1 -v b=$2 'BEGIN { printf "%.2f", b ? a / b : 0 }'
+}
+
+echo "time to depth $depth: private $private_time ms, shared $shared_time ms, gain `gain $private_time $shared_time`"
+echo "nodes to depth $depth: private $private_nodes, shared $shared_nodes, gain `gain $private_nodes $shared_nodes`"
+
+echo "sharedhash testing OK"
@@ -0,0 +1,59 @@
+#!/bin/bash
+# compare the default and the lockless (lockless=yes) TT entries over thread
+# counts: the NPS of bench, and with the TT statistics of ttstats=yes builds,
+# the rate of key16 collisions (hits on an entry of another position, per hit)
+# and of rejected entries (saved for the probed position but torn, so not found,
+# per probe). The checksum of the lockless entries only catches the latter.
+#
+# usage: ttlockless.sh [threads] [depth] [evalType]
+# where threads is a comma separated list, like "1,2,4,8" (the default).
+# Run from src, the binaries are built for ARCH (default native) and removed.
+
+error()
+{
+  echo "ttlockless testing failed on line $1"
+  rm -f stockfish-lockless-*
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+threads=${1:-1,2,4,8}
+depth=${2:-13}
+evaltype=${3:-mixed}
+arch=${ARCH:-native}
+
+echo "ttlockless testing started"
+
+make net > /dev/null
+
+for lockless in no yes
+do
+  for ttstats in no yes
+  do
+    make objclean
+    make -j all ARCH=$arch lockless=$lockless ttstats=$ttstats > /dev/null 2>&1
+    mv stockfish stockfish-lockless-$lockless-$ttstats
+  done
+done
+
+for t in ${threads//,/ }
+do
+  for lockless in no yes
+  do
+    nps=`./stockfish-lockless-$lockless-no bench 64 $t $depth default depth $evaltype 2>&1 \
+         | awk '/^Nodes\/second/ { print $3 }'`
+
+    rates=`./stockfish-lockless-$lockless-yes bench 64 $t $depth default depth $evaltype 2>&1 \
+           | awk '$1 == "total" { for (i = 2; i < NF; ++i) c[$i] = $(i+1)
+                                  printf "collisions %.4f%% rejected %.4f%%",
+                                         c["hits"] ? 100 * c["collisions"] / c["hits"] : 0,
+                                         c["probes"] ? 100 * c["rejected"] / c["probes"] : 0 }'`
+
+    echo "lockless $lockless threads $t nps $nps $rates"
+  done
+done
+
+rm -f stockfish-lockless-*
+make objclean
+
+echo "ttlockless testing OK"